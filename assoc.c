@@ -24,8 +24,13 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <strings.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 typedef  unsigned long  int  ub4;   /* unsigned 4-byte quantities */
@@ -37,21 +42,47 @@ unsigned int hashpower = HASHPOWER_DEFAULT;
 #define hashsize(n) ((ub4)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
+/* Never shrink below the size we started with. */
+static unsigned int hashpower_min = HASHPOWER_DEFAULT;
+
 /* Main hash table. This is where we look except during expansion. */
 static item** primary_hashtable = 0;
 
 /*
- * Previous hash table. During expansion, we look here for keys that haven't
- * been moved over to the primary yet.
+ * Previous hash table. During expansion or shrinking, we look here for keys
+ * that haven't been moved over to the primary yet.
  */
 static item** old_hashtable = 0;
 
-/* Number of items in the hash table. */
+/*
+ * Bucketed layout (-o hash_layout=bucketed). Each bucket fills a cache line
+ * with a few item pointers and an 8 bit tag per pointer, taken from the top
+ * of the item's hash. A lookup compares all tags at once and only touches
+ * items whose tag matches, so a miss usually costs a single cache line.
+ * Items that don't fit in the slots are chained off the bucket through
+ * h_next, as in the classic layout.
+ */
+#define BUCKET_SLOTS 6
+
+typedef struct {
+    uint8_t tags[8];            /* 0 marks a free slot; the last two stay 0 */
+    item *slots[BUCKET_SLOTS];
+    item *overflow;
+} bucket_t;
+
+static bucket_t *primary_buckets = 0;
+static bucket_t *old_buckets = 0;
+
+#define BUCKETED (settings.hash_layout == HASH_LAYOUT_BUCKETED)
+
+/* Number of items in the hash table. Inserts and deletes only hold the
+ * item lock of their key, so changes to it take hash_items_lock. */
 static unsigned int hash_items = 0;
+static pthread_mutex_t hash_items_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Flag: Are we in the middle of expanding now? */
 static bool expanding = false;
-static bool started_expanding = false;
+static bool started_resizing = false;
 
 /*
  * During expansion we migrate values with bucket granularity; this is how
@@ -59,140 +90,520 @@ static bool started_expanding = false;
  */
 static unsigned int expand_bucket = 0;
 
+/*
+ * Shrinking is expansion run backwards: the old table is twice the size of
+ * the primary, and each pair of old buckets folds into one primary bucket.
+ * shrink_bucket is the next old bucket to fold, 0 .. hashsize(hashpower).
+ */
+static bool shrinking = false;
+static unsigned int shrink_bucket = 0;
+
+/* Size of one entry of the table, for hash_bytes. */
+static size_t table_entry_size(void) {
+    return BUCKETED ? sizeof(bucket_t) : sizeof(void *);
+}
+
+/* Items we take before growing: 1.5 per chain, or three quarters of the
+ * slots when bucketed. */
+static ub4 grow_threshold(void) {
+    if (BUCKETED)
+        return (hashsize(hashpower) * BUCKET_SLOTS * 3) / 4;
+    return (hashsize(hashpower) * 3) / 2;
+}
+
+/* Allocates a zeroed table of hashsize(power) entries into *table. */
+static bool table_alloc(void **table, const unsigned int power) {
+    size_t len = hashsize(power) * table_entry_size();
+    if (BUCKETED) {
+        if (posix_memalign(table, sizeof(bucket_t), len) != 0) {
+            *table = NULL;
+            return false;
+        }
+        memset(*table, 0, len);
+    } else {
+        *table = calloc(hashsize(power), sizeof(void *));
+    }
+    return *table != NULL;
+}
+
 void assoc_init(const int hashtable_init) {
+    void *table;
     if (hashtable_init) {
         hashpower = hashtable_init;
     }
-    primary_hashtable = calloc(hashsize(hashpower), sizeof(void *));
-    if (! primary_hashtable) {
+    hashpower_min = hashpower;
+    if (! table_alloc(&table, hashpower)) {
         fprintf(stderr, "Failed to init hashtable.\n");
         exit(EXIT_FAILURE);
     }
+    if (BUCKETED) {
+        primary_buckets = table;
+    } else {
+        primary_hashtable = table;
+    }
     STATS_LOCK();
     stats.hash_power_level = hashpower;
-    stats.hash_bytes = hashsize(hashpower) * sizeof(void *);
+    stats.hash_bytes = hashsize(hashpower) * table_entry_size();
     STATS_UNLOCK();
 }
 
-item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
-    item *it;
+/* The chain (classic layout) or bucket (bucketed layout) hv lives in. */
+static item** _hashitem_chain(const uint32_t hv) {
     unsigned int oldbucket;
 
     if (expanding &&
         (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
     {
-        it = old_hashtable[oldbucket];
+        return &old_hashtable[oldbucket];
+    }
+    if (shrinking &&
+        (oldbucket = (hv & hashmask(hashpower + 1))) >= shrink_bucket)
+    {
+        return &old_hashtable[oldbucket];
+    }
+    return &primary_hashtable[hv & hashmask(hashpower)];
+}
+
+static bucket_t *_hashitem_bucket(const uint32_t hv) {
+    unsigned int oldbucket;
+
+    if (expanding &&
+        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
+    {
+        return &old_buckets[oldbucket];
+    }
+    if (shrinking &&
+        (oldbucket = (hv & hashmask(hashpower + 1))) >= shrink_bucket)
+    {
+        return &old_buckets[oldbucket];
+    }
+    return &primary_buckets[hv & hashmask(hashpower)];
+}
+
+static inline uint8_t bucket_tag(const uint32_t hv) {
+    uint8_t tag = hv >> 24;
+    return tag ? tag : 1;
+}
+
+/* Returns a bitmask of the slots of b holding tag. */
+static inline unsigned int bucket_match(const bucket_t *b, const uint8_t tag) {
+#ifdef __SSE2__
+    __m128i tags = _mm_loadl_epi64((const __m128i *)b->tags);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8((char)tag)))
+        & ((1 << BUCKET_SLOTS) - 1);
+#else
+    unsigned int i, mask = 0;
+    for (i = 0; i < BUCKET_SLOTS; i++) {
+        if (b->tags[i] == tag)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+static void bucket_insert(bucket_t *b, item *it, const uint32_t hv) {
+    unsigned int free_slots = bucket_match(b, 0);
+
+    if (free_slots) {
+        int i = ffs(free_slots) - 1;
+        it->h_next = 0;
+        b->slots[i] = it;
+        b->tags[i] = bucket_tag(hv);
     } else {
-        it = primary_hashtable[hv & hashmask(hashpower)];
+        ITEM_set_h_next(it, b->overflow);
+        b->overflow = it;
     }
+}
 
+item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
+    item *it;
     item *ret = NULL;
     int depth = 0;
+
+    if (BUCKETED) {
+        bucket_t *b = _hashitem_bucket(hv);
+        unsigned int mask = bucket_match(b, bucket_tag(hv));
+        while (mask) {
+            it = b->slots[ffs(mask) - 1];
+            mask &= mask - 1;
+            if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+                MEMCACHED_ASSOC_FIND(key, nkey, depth);
+                return it;
+            }
+            ++depth;
+        }
+        it = b->overflow;
+    } else {
+        it = *_hashitem_chain(hv);
+    }
+
     while (it) {
         if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
             ret = it;
             break;
         }
-        it = it->h_next;
+        it = ITEM_h_next(it);
         ++depth;
     }
     MEMCACHED_ASSOC_FIND(key, nkey, depth);
     return ret;
 }
 
-/* returns the address of the item pointer before the key.  if *item == 0,
-   the item wasn't found */
+/* True if it is linked in the table under hv. Only compares pointers, so it
+ * may be any address that once held an item. */
+bool assoc_contains(const item *it, const uint32_t hv) {
+    item *iter;
+
+    if (BUCKETED) {
+        bucket_t *b = _hashitem_bucket(hv);
+        unsigned int mask = bucket_match(b, bucket_tag(hv));
+        while (mask) {
+            if (b->slots[ffs(mask) - 1] == it)
+                return true;
+            mask &= mask - 1;
+        }
+        iter = b->overflow;
+    } else {
+        iter = *_hashitem_chain(hv);
+    }
+    for (; iter != NULL; iter = ITEM_h_next(iter)) {
+        if (iter == it)
+            return true;
+    }
+    return false;
+}
+
+/* Starts loading the bucket (or chain head) hv lives in. Only the address
+ * is computed, the table isn't read, so no lock is needed. */
+void assoc_prefetch(const uint32_t hv) {
+    if (BUCKETED) {
+        prefetch(_hashitem_bucket(hv));
+    } else {
+        prefetch(_hashitem_chain(hv));
+    }
+}
 
-static item** _hashitem_before (const char *key, const size_t nkey, const uint32_t hv) {
-    item **pos;
-    unsigned int oldbucket;
+/* Lock-free counterpart of assoc_find() for item_get_optimistic(). The walk
+ * is checked against the chain's sequence counter, seq, at every hop.
+ * Returns false if a writer touched the chain (or the table is being
+ * resized), in which case *itp is meaningless and the caller must retry
+ * under the item lock. */
+bool assoc_find_optimistic(const char *key, const size_t nkey,
+                           const uint32_t hv, const unsigned int seq,
+                           item **itp) {
+    item *it;
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        pos = &old_hashtable[oldbucket];
+    *itp = NULL;
+    if (expanding || shrinking)
+        return false;
+
+    if (BUCKETED) {
+        bucket_t *b = &primary_buckets[hv & hashmask(hashpower)];
+        unsigned int mask = bucket_match(b, bucket_tag(hv));
+        while (mask) {
+            it = b->slots[ffs(mask) - 1];
+            mask &= mask - 1;
+            if (item_lock_seq(hv) != seq || it == NULL)
+                return false;
+            if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+                *itp = it;
+                return item_lock_seq(hv) == seq;
+            }
+        }
+        it = b->overflow;
     } else {
-        pos = &primary_hashtable[hv & hashmask(hashpower)];
+        it = primary_hashtable[hv & hashmask(hashpower)];
+    }
+
+    while (it) {
+        if (item_lock_seq(hv) != seq)
+            return false;
+        if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+            *itp = it;
+            break;
+        }
+        it = ITEM_h_next(it);
     }
+    return item_lock_seq(hv) == seq;
+}
+
+/* returns the item with the key in the chain starting at it, or NULL if it
+   wasn't found. *prev is set to the item before it in the chain, or NULL if
+   it is the head. */
 
-    while (*pos && ((nkey != (*pos)->nkey) || memcmp(key, ITEM_key(*pos), nkey))) {
-        pos = &(*pos)->h_next;
+static item* _hashitem_before (item *it, const char *key, const size_t nkey,
+                               item **prev) {
+    *prev = NULL;
+    while (it && ((nkey != it->nkey) || memcmp(key, ITEM_key(it), nkey))) {
+        *prev = it;
+        it = ITEM_h_next(it);
     }
-    return pos;
+    return it;
 }
 
 /* grows the hashtable to the next power of 2. */
 static void assoc_expand(void) {
-    old_hashtable = primary_hashtable;
+    void *table;
 
-    primary_hashtable = calloc(hashsize(hashpower + 1), sizeof(void *));
-    if (primary_hashtable) {
+    if (table_alloc(&table, hashpower + 1)) {
         if (settings.verbose > 1)
             fprintf(stderr, "Hash table expansion starting\n");
+        if (BUCKETED) {
+            old_buckets = primary_buckets;
+            primary_buckets = table;
+        } else {
+            old_hashtable = primary_hashtable;
+            primary_hashtable = table;
+        }
         hashpower++;
         expanding = true;
         expand_bucket = 0;
         STATS_LOCK();
         stats.hash_power_level = hashpower;
-        stats.hash_bytes += hashsize(hashpower) * sizeof(void *);
+        stats.hash_bytes += hashsize(hashpower) * table_entry_size();
         stats.hash_is_expanding = 1;
         STATS_UNLOCK();
     } else {
-        primary_hashtable = old_hashtable;
         /* Bad news, but we can keep running. */
     }
 }
 
-static void assoc_start_expand(void) {
-    if (started_expanding)
-        return;
-    started_expanding = true;
-    pthread_cond_signal(&maintenance_cond);
+/* Wakes the maintenance thread, which works out whether to grow or shrink. */
+static void assoc_start_resize(void) {
+    mutex_lock(&maintenance_lock);
+    if (!started_resizing) {
+        started_resizing = true;
+        pthread_cond_signal(&maintenance_cond);
+    }
+    mutex_unlock(&maintenance_lock);
+}
+
+/* Adds delta to hash_items, returning the new count. */
+static unsigned int hash_items_add(const int delta) {
+    unsigned int n;
+    mutex_lock(&hash_items_lock);
+    hash_items += delta;
+    n = hash_items;
+    mutex_unlock(&hash_items_lock);
+    return n;
+}
+
+/* True once the table is mostly empty: fewer items than hash_shrink_pct
+ * percent of what would make it grow. */
+static bool shrink_wanted(void) {
+    return settings.hash_shrink_pct > 0 && !expanding && !shrinking &&
+        hashpower > hashpower_min &&
+        hash_items < (uint64_t)grow_threshold() * settings.hash_shrink_pct / 100;
+}
+
+/* halves the hashtable. */
+static void assoc_shrink(void) {
+    void *table;
+
+    if (table_alloc(&table, hashpower - 1)) {
+        if (settings.verbose > 1)
+            fprintf(stderr, "Hash table shrinking starting\n");
+        if (BUCKETED) {
+            old_buckets = primary_buckets;
+            primary_buckets = table;
+        } else {
+            old_hashtable = primary_hashtable;
+            primary_hashtable = table;
+        }
+        hashpower--;
+        shrinking = true;
+        shrink_bucket = 0;
+        STATS_LOCK();
+        stats.hash_power_level = hashpower;
+        stats.hash_bytes += hashsize(hashpower) * table_entry_size();
+        stats.hash_is_shrinking = 1;
+        STATS_UNLOCK();
+    }
 }
 
 /* Note: this isn't an assoc_update.  The key must not already exist to call this */
 int assoc_insert(item *it, const uint32_t hv) {
-    unsigned int oldbucket;
-
+    unsigned int items;
 //    assert(assoc_find(ITEM_key(it), it->nkey) == 0);  /* shouldn't have duplicately named things defined */
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        it->h_next = old_hashtable[oldbucket];
-        old_hashtable[oldbucket] = it;
+    item_lock_seq_bump(hv);
+    if (BUCKETED) {
+        bucket_insert(_hashitem_bucket(hv), it, hv);
     } else {
-        it->h_next = primary_hashtable[hv & hashmask(hashpower)];
-        primary_hashtable[hv & hashmask(hashpower)] = it;
+        item **chain = _hashitem_chain(hv);
+        ITEM_set_h_next(it, *chain);
+        *chain = it;
     }
+    item_lock_seq_bump(hv);
 
-    hash_items++;
-    if (! expanding && hash_items > (hashsize(hashpower) * 3) / 2) {
-        assoc_start_expand();
+    items = hash_items_add(1);
+    if (! expanding && ! shrinking && items > grow_threshold()) {
+        assoc_start_resize();
     }
 
-    MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey, hash_items);
+    MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey, items);
     return 1;
 }
 
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv) {
-    item **before = _hashitem_before(key, nkey, hv);
+    item **head;
+    item *it, *prev;
+
+    if (BUCKETED) {
+        bucket_t *b = _hashitem_bucket(hv);
+        unsigned int mask = bucket_match(b, bucket_tag(hv));
+        while (mask) {
+            int i = ffs(mask) - 1;
+            it = b->slots[i];
+            mask &= mask - 1;
+            if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+                hash_items_add(-1);
+                MEMCACHED_ASSOC_DELETE(key, nkey, hash_items);
+                item_lock_seq_bump(hv);
+                b->tags[i] = 0;
+                b->slots[i] = NULL;
+                item_lock_seq_bump(hv);
+                if (shrink_wanted())
+                    assoc_start_resize();
+                return;
+            }
+        }
+        head = &b->overflow;
+    } else {
+        head = _hashitem_chain(hv);
+    }
 
-    if (*before) {
-        item *nxt;
-        hash_items--;
+    it = _hashitem_before(*head, key, nkey, &prev);
+    if (it) {
+        hash_items_add(-1);
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
         MEMCACHED_ASSOC_DELETE(key, nkey, hash_items);
-        nxt = (*before)->h_next;
-        (*before)->h_next = 0;   /* probably pointless, but whatever. */
-        *before = nxt;
+        item_lock_seq_bump(hv);
+        if (prev)
+            prev->h_next = it->h_next;
+        else
+            *head = ITEM_h_next(it);
+        it->h_next = 0;   /* probably pointless, but whatever. */
+        item_lock_seq_bump(hv);
+        if (shrink_wanted())
+            assoc_start_resize();
         return;
     }
     /* Note:  we never actually get here.  the callers don't delete things
        they can't find. */
-    assert(*before != 0);
+    assert(it != 0);
+}
+
+static uint32_t reverse_bits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+    v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);
+    v = ((v >> 8) & 0x00FF00FF) | ((v & 0x00FF00FF) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+/* Calls cb on every item in one bucket of table. */
+static void scan_bucket(void *table, const unsigned int bucket,
+                        assoc_scan_cb cb, void *arg) {
+    item *it, *next;
+
+    if (BUCKETED) {
+        bucket_t *b = &((bucket_t *)table)[bucket];
+        int i;
+        for (i = 0; i < BUCKET_SLOTS; i++) {
+            if (b->tags[i] != 0)
+                cb(b->slots[i], arg);
+        }
+        it = b->overflow;
+    } else {
+        it = ((item **)table)[bucket];
+    }
+    for (; it != NULL; it = next) {
+        next = ITEM_h_next(it);
+        cb(it, arg);
+    }
+}
+
+/*
+ * Calls cb on every item of one bucket and returns the cursor of the next
+ * one, or 0 once the whole table has been covered; a walk starts at 0. Only
+ * the item lock of that bucket is held while cb runs, so the table can be
+ * walked a few buckets at a time without holding up requests.
+ *
+ * As with Redis' SCAN, the cursor counts with its bits reversed. While the
+ * table is resizing a cursor names a bucket of the smaller table, along with
+ * the buckets of the bigger one its items split into. So a walk that spans
+ * any number of resizes returns every item that was there throughout at
+ * least once, though it may return some twice.
+ */
+uint32_t assoc_scan(uint32_t cursor, assoc_scan_cb cb, void *arg) {
+    unsigned int power, bucket;
+    unsigned long int i;
+
+    /* The stripe is the same at every size, and while it's held the tables
+     * can't be swapped nor this bucket migrated. */
+    item_lock_bucket(cursor & hashmask(hashpower_min), hashpower_min);
+    power = expanding ? hashpower - 1 : hashpower;
+    bucket = cursor & hashmask(power);
+
+    for (i = bucket; i < hashsize(hashpower); i += hashsize(power)) {
+        scan_bucket(BUCKETED ? (void *)primary_buckets : (void *)primary_hashtable,
+                    i, cb, arg);
+    }
+    if (expanding && bucket >= expand_bucket) {
+        scan_bucket(BUCKETED ? (void *)old_buckets : (void *)old_hashtable,
+                    bucket, cb, arg);
+    }
+    if (shrinking) {
+        for (i = bucket; i < hashsize(hashpower + 1); i += hashsize(power)) {
+            if (i >= shrink_bucket)
+                scan_bucket(BUCKETED ? (void *)old_buckets : (void *)old_hashtable,
+                            i, cb, arg);
+        }
+    }
+    item_unlock_bucket(cursor & hashmask(hashpower_min), hashpower_min);
+
+    cursor |= ~(uint32_t)hashmask(power);
+    return reverse_bits(reverse_bits(cursor) + 1);
+}
+
+/* Moves everything in bucket of the old table over to the primary one. The
+ * caller holds the item locks covering both the bucket and where its items
+ * land in the primary table. */
+static void assoc_move_bucket(const unsigned int bucket) {
+    item *it, *next;
+    uint32_t hv;
+
+    if (BUCKETED) {
+        bucket_t *b = &old_buckets[bucket];
+        int i;
+        for (i = 0; i < BUCKET_SLOTS; i++) {
+            if (b->tags[i] == 0)
+                continue;
+            it = b->slots[i];
+            hv = ITEM_hv(it);
+            bucket_insert(&primary_buckets[hv & hashmask(hashpower)], it, hv);
+        }
+        for (it = b->overflow; NULL != it; it = next) {
+            next = ITEM_h_next(it);
+            hv = ITEM_hv(it);
+            bucket_insert(&primary_buckets[hv & hashmask(hashpower)], it, hv);
+        }
+        memset(b, 0, sizeof(*b));
+        return;
+    }
+
+    for (it = old_hashtable[bucket]; NULL != it; it = next) {
+        next = ITEM_h_next(it);
+
+        hv = ITEM_hv(it);
+        ITEM_set_h_next(it, primary_hashtable[hv & hashmask(hashpower)]);
+        primary_hashtable[hv & hashmask(hashpower)] = it;
+    }
+
+    old_hashtable[bucket] = NULL;
 }
 
 
@@ -206,56 +617,91 @@ static void *assoc_maintenance_thread(void *arg) {
     while (do_run_maintenance_thread) {
         int ii = 0;
 
-        /* Lock the cache, and bulk move multiple buckets to the new
-         * hash table. */
-        item_lock_global();
-        mutex_lock(&cache_lock);
-
+        /* Bulk move multiple buckets to the new hash table. Each bucket is
+         * moved holding only the item lock(s) covering it, so workers keep
+         * using the striped locks and only wait when they touch the bucket
+         * being moved. */
         for (ii = 0; ii < hash_bulk_move && expanding; ++ii) {
-            item *it, *next;
-            int bucket;
-
-            for (it = old_hashtable[expand_bucket]; NULL != it; it = next) {
-                next = it->h_next;
-
-                bucket = hash(ITEM_key(it), it->nkey, 0) & hashmask(hashpower);
-                it->h_next = primary_hashtable[bucket];
-                primary_hashtable[bucket] = it;
-            }
+            unsigned int moving = expand_bucket;
 
-            old_hashtable[expand_bucket] = NULL;
+            item_lock_bucket(moving, hashpower - 1);
+            assoc_move_bucket(moving);
 
+            /* Must move on while we hold the bucket's lock: anybody locking
+             * it next relies on seeing the new expand_bucket. */
             expand_bucket++;
             if (expand_bucket == hashsize(hashpower - 1)) {
                 expanding = false;
                 free(old_hashtable);
+                free(old_buckets);
+                old_hashtable = NULL;
+                old_buckets = NULL;
                 STATS_LOCK();
-                stats.hash_bytes -= hashsize(hashpower - 1) * sizeof(void *);
+                stats.hash_bytes -= hashsize(hashpower - 1) * table_entry_size();
                 stats.hash_is_expanding = 0;
+                stats.hash_buckets_moved = 0;
                 STATS_UNLOCK();
                 if (settings.verbose > 1)
                     fprintf(stderr, "Hash table expansion done\n");
             }
+
+            item_unlock_bucket(moving, hashpower - 1);
         }
 
-        mutex_unlock(&cache_lock);
-        item_unlock_global();
+        /* Shrinking folds each old bucket into the primary bucket it maps
+         * to. That bucket also takes the old bucket's twin, so lock it at
+         * the new size: its locks cover both halves. */
+        for (ii = 0; ii < hash_bulk_move && shrinking; ++ii) {
+            unsigned int moving = shrink_bucket;
+            unsigned int target = moving & hashmask(hashpower);
 
-        if (!expanding) {
-            /* finished expanding. tell all threads to use fine-grained locks */
-            switch_item_lock_type(ITEM_LOCK_GRANULAR);
-            slabs_rebalancer_resume();
-            /* We are done expanding.. just wait for next invocation */
-            mutex_lock(&cache_lock);
-            started_expanding = false;
-            pthread_cond_wait(&maintenance_cond, &cache_lock);
-            /* Before doing anything, tell threads to use a global lock */
-            mutex_unlock(&cache_lock);
+            item_lock_bucket(target, hashpower);
+            assoc_move_bucket(moving);
+
+            shrink_bucket++;
+            if (shrink_bucket == hashsize(hashpower + 1)) {
+                shrinking = false;
+                free(old_hashtable);
+                free(old_buckets);
+                old_hashtable = NULL;
+                old_buckets = NULL;
+                STATS_LOCK();
+                stats.hash_bytes -= hashsize(hashpower + 1) * table_entry_size();
+                stats.hash_is_shrinking = 0;
+                stats.hash_buckets_moved = 0;
+                STATS_UNLOCK();
+                if (settings.verbose > 1)
+                    fprintf(stderr, "Hash table shrinking done\n");
+            }
+
+            item_unlock_bucket(target, hashpower);
+        }
+
+        if (expanding || shrinking) {
+            STATS_LOCK();
+            stats.hash_buckets_moved = expanding ? expand_bucket : shrink_bucket;
+            STATS_UNLOCK();
+        } else {
+            /* We are done resizing.. just wait for next invocation */
+            mutex_lock(&maintenance_lock);
+            started_resizing = false;
+            /* Shrinks are only asked for on delete. If the table is still
+             * too empty after one, go again rather than wait for another. */
+            if (!shrink_wanted())
+                pthread_cond_wait(&maintenance_cond, &maintenance_lock);
+            mutex_unlock(&maintenance_lock);
+            /* Swapping in the new table is the only step that needs every
+             * bucket to hold still. With every lock held hash_items is
+             * stable too, so decide here which way to go. */
             slabs_rebalancer_pause();
-            switch_item_lock_type(ITEM_LOCK_GLOBAL);
-            mutex_lock(&cache_lock);
-            assoc_expand();
-            mutex_unlock(&cache_lock);
+            item_lock_all();
+            if (hash_items > grow_threshold()) {
+                assoc_expand();
+            } else if (shrink_wanted()) {
+                assoc_shrink();
+            }
+            item_unlock_all();
+            slabs_rebalancer_resume();
         }
     }
     return NULL;
@@ -281,10 +727,10 @@ int start_assoc_maintenance_thread() {
 }
 
 void stop_assoc_maintenance_thread() {
-    mutex_lock(&cache_lock);
+    mutex_lock(&maintenance_lock);
     do_run_maintenance_thread = 0;
     pthread_cond_signal(&maintenance_cond);
-    mutex_unlock(&cache_lock);
+    mutex_unlock(&maintenance_lock);
 
     /* Wait for the maintenance thread to stop */
     pthread_join(maintenance_tid, NULL);
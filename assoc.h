@@ -1,9 +1,16 @@
 /* associative array */
 void assoc_init(const int hashpower_init);
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv);
+bool assoc_find_optimistic(const char *key, const size_t nkey,
+                           const uint32_t hv, const unsigned int seq,
+                           item **itp);
+bool assoc_contains(const item *it, const uint32_t hv);
+void assoc_prefetch(const uint32_t hv);
 int assoc_insert(item *item, const uint32_t hv);
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv);
 void do_assoc_move_next_bucket(void);
+typedef void (*assoc_scan_cb)(item *it, void *arg);
+uint32_t assoc_scan(uint32_t cursor, assoc_scan_cb cb, void *arg);
 int start_assoc_maintenance_thread(void);
 void stop_assoc_maintenance_thread(void);
 extern unsigned int hashpower;
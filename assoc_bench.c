@@ -0,0 +1,210 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Micro benchmark for the hash table layouts in assoc.c.
+ *
+ * For every hash power in the requested range the table is filled with
+ * 1.5 items per bucket (the most the chained layout takes before growing)
+ * and timed on random hits and misses, once per layout. Each run happens in
+ * its own process so big tables are given back before the next one.
+ *
+ * The full 16..28 range needs a lot of memory (tens of GB at 28), so by
+ * default only 16..22 is run; use -p to go further.
+ */
+#include "memcached.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define KEY_SIZE 24
+
+#define hashsize(n) ((unsigned long int)1<<(n))
+
+/* assoc.c is linked on its own; these stand in for the rest of the server.
+ * Nothing here runs concurrently, so the locks have nothing to do. */
+void STATS_LOCK(void) {
+}
+
+void STATS_UNLOCK(void) {
+}
+
+void item_lock_seq_bump(uint32_t hv) {
+}
+
+unsigned int item_lock_seq(uint32_t hv) {
+    return 0;
+}
+
+void item_lock_bucket(uint32_t bucket, unsigned int power) {
+}
+
+void item_unlock_bucket(uint32_t bucket, unsigned int power) {
+}
+
+void item_lock_all(void) {
+}
+
+void item_unlock_all(void) {
+}
+
+void slabs_rebalancer_pause(void) {
+}
+
+void slabs_rebalancer_resume(void) {
+}
+
+#ifdef COMPACT_ITEMS
+char *item_arena = NULL;
+#endif
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint32_t rnd(void) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return (uint32_t)(rnd_state >> 16);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct probe {
+    char key[KEY_SIZE];
+    size_t nkey;
+    uint32_t hv;
+};
+
+/* Times lookups over probes, returning nanoseconds per lookup. found is set
+ * to the number of hits, so the compiler can't drop the calls. */
+static double time_lookups(const struct probe *probes, const int nprobes,
+                           int *found) {
+    double start = now();
+    int i;
+    *found = 0;
+    for (i = 0; i < nprobes; i++) {
+        if (assoc_find(probes[i].key, probes[i].nkey, probes[i].hv) != NULL)
+            (*found)++;
+    }
+    return (now() - start) * 1e9 / nprobes;
+}
+
+static void run(const enum hash_layout layout, const int power,
+                const int nprobes) {
+    const size_t nitems = (hashsize(power) * 3) / 2;
+    const size_t isize = (sizeof(item) + KEY_SIZE + 7) & ~(size_t)7;
+    struct probe *probes;
+    char *items;
+    size_t i;
+    int found_hits, found_misses;
+    double hit_ns, miss_ns;
+
+    settings.hash_layout = layout;
+    assoc_init(power);
+
+    items = calloc(nitems, isize);
+    probes = calloc(nprobes, sizeof(struct probe));
+    if (items == NULL || probes == NULL) {
+        fprintf(stderr, "hashpower %d: out of memory\n", power);
+        exit(EXIT_FAILURE);
+    }
+#ifdef COMPACT_ITEMS
+    item_arena = items;
+#endif
+
+    for (i = 0; i < nitems; i++) {
+        item *it = (item *)(items + i * isize);
+        it->nkey = snprintf(ITEM_key(it), KEY_SIZE, "key:%lu", (unsigned long)i);
+#ifndef COMPACT_ITEMS
+        it->hv = hash(ITEM_key(it), it->nkey, 0);
+#endif
+        assoc_insert(it, ITEM_hv(it));
+    }
+
+    for (i = 0; i < nprobes; i++) {
+        probes[i].nkey = snprintf(probes[i].key, KEY_SIZE, "key:%lu",
+                                  (unsigned long)(rnd() % nitems));
+        probes[i].hv = hash(probes[i].key, probes[i].nkey, 0);
+    }
+    hit_ns = time_lookups(probes, nprobes, &found_hits);
+
+    for (i = 0; i < nprobes; i++) {
+        probes[i].nkey = snprintf(probes[i].key, KEY_SIZE, "miss:%lu",
+                                  (unsigned long)rnd());
+        probes[i].hv = hash(probes[i].key, probes[i].nkey, 0);
+    }
+    miss_ns = time_lookups(probes, nprobes, &found_misses);
+
+    assert(found_hits == nprobes);
+    assert(found_misses == 0);
+
+    printf("%-9s %9d %12lu %12.1f %10.1f %10.1f\n",
+           layout == HASH_LAYOUT_BUCKETED ? "bucketed" : "chained",
+           power, (unsigned long)nitems, stats.hash_bytes / 1048576.0,
+           hit_ns, miss_ns);
+}
+
+static void usage(void) {
+    printf("assoc_bench [-l chained|bucketed] [-p min[:max]] [-n lookups]\n");
+}
+
+int main(int argc, char **argv) {
+    int c;
+    int minpower = 16, maxpower = 22;
+    int nprobes = 2000000;
+    bool want[2] = { true, true };
+    int power, layout;
+
+    while ((c = getopt(argc, argv, "l:p:n:h")) != -1) {
+        switch (c) {
+        case 'l':
+            want[HASH_LAYOUT_CHAINED] = strcmp(optarg, "chained") == 0;
+            want[HASH_LAYOUT_BUCKETED] = strcmp(optarg, "bucketed") == 0;
+            break;
+        case 'p':
+            if (sscanf(optarg, "%d:%d", &minpower, &maxpower) == 1)
+                maxpower = minpower;
+            break;
+        case 'n':
+            nprobes = atoi(optarg);
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (minpower < 1 || maxpower > 31 || minpower > maxpower || nprobes < 1) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    printf("%-9s %9s %12s %12s %10s %10s\n", "layout", "hashpower",
+           "items", "table MB", "hit ns", "miss ns");
+    for (power = minpower; power <= maxpower; power++) {
+        for (layout = HASH_LAYOUT_CHAINED; layout <= HASH_LAYOUT_BUCKETED; layout++) {
+            pid_t pid;
+            int status;
+            if (!want[layout])
+                continue;
+            fflush(stdout);
+            if ((pid = fork()) == 0) {
+                run(layout, power, nprobes);
+                fflush(stdout);
+                _exit(0);
+            }
+            if (pid == -1 || waitpid(pid, &status, 0) != pid ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "run at hashpower %d failed\n", power);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
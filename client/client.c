@@ -38,7 +38,7 @@ void ib_read_bytes(char *str, int length, uint8_t *out);
 
 /* ib_client.c */
 int client_set(resource_t *res, char *key, uint key_len, uint data_len, char *data);
-void client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data);
+int client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data);
 void client_stop(resource_t *res);
 
 resource_t res;
@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * CRC32C (Castagnoli) used as a key hash. On x86-64 CPUs with SSE4.2 the
+ * crc32 instruction does eight bytes per cycle or so; elsewhere a table
+ * driven version is used, which works but is slower than the other hashes.
+ *
+ * A CRC is linear and mixes its low bits poorly, so crc32c_hash() runs the
+ * result through murmur3's finalizer before handing it out.
+ */
+#include "memcached.h"
+#include "crc32c_hash.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#define CRC32C_HW_CAPABLE 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78 /* reflected Castagnoli polynomial */
+
+static uint32_t crc32c_table[256];
+static bool crc32c_hw = false;
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t length) {
+    while (length--) {
+        crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HW_CAPABLE
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t length) {
+    uint64_t crc64 = crc;
+    uint32_t crc32;
+
+    for (; length >= 8; p += 8, length -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        __asm__("crc32q %1, %0" : "+r" (crc64) : "rm" (v));
+    }
+    crc32 = (uint32_t)crc64;
+    for (; length > 0; p++, length--) {
+        __asm__("crc32b %1, %0" : "+r" (crc32) : "rm" (*p));
+    }
+    return crc32;
+}
+#endif
+
+/* Builds the fallback table and checks for the crc32 instruction. Returns
+ * true if the hardware path is used. Safe to call more than once. */
+bool crc32c_init(void) {
+    uint32_t i, j, crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        crc32c_table[i] = crc;
+    }
+
+#ifdef CRC32C_HW_CAPABLE
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2))
+            crc32c_hw = true;
+    }
+#endif
+    return crc32c_hw;
+}
+
+/* Standard CRC32C: crc32c(0, "123456789", 9) == 0xe3069283. Pass the
+ * previous result as crc to continue a running checksum. */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    crc = ~crc;
+#ifdef CRC32C_HW_CAPABLE
+    if (crc32c_hw)
+        return ~crc32c_sse42(crc, data, length);
+#endif
+    return ~crc32c_sw(crc, data, length);
+}
+
+uint32_t crc32c_hash(const void *key, size_t length, const uint32_t initval) {
+    uint32_t h = crc32c(initval, key, length);
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
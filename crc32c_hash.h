@@ -0,0 +1,16 @@
+#ifndef CRC32C_HASH_H
+#define    CRC32C_HASH_H
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+bool crc32c_init(void);
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_hash(const void *key, size_t length, const uint32_t initval);
+
+#ifdef    __cplusplus
+}
+#endif
+
+#endif    /* CRC32C_HASH_H */
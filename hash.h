@@ -5,11 +5,25 @@
 extern "C" {
 #endif
 
-uint32_t hash(const void *key, size_t length, const uint32_t initval);
+typedef uint32_t (*hash_func)(const void *key, size_t length, const uint32_t initval);
+
+/* The hash function used for keys; set once by hash_init() at startup. */
+extern hash_func hash;
+
+enum hashfunc_type {
+    JENKINS_HASH = 0,
+    MURMUR3_HASH,
+    CRC32C_HASH,
+    SIPHASH_HASH
+};
+
+int hash_init(enum hashfunc_type type);
+bool hash_type_from_name(const char *name, enum hashfunc_type *type);
+const char *hash_type_name(enum hashfunc_type type);
+const char *hash_algorithm(void);
 
 #ifdef    __cplusplus
 }
 #endif
 
 #endif    /* HASH_H */
-
@@ -0,0 +1,117 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Micro benchmark for the key hash functions selectable with
+ * -o hash_algorithm=.
+ *
+ * Hashes a ring of random keys of each length and reports the average
+ * cost per key, in TSC cycles on x86 and nanoseconds elsewhere. The keys
+ * are spread over more memory than fits in L1 so each hash also pays for
+ * reading its key, as it does in the server.
+ */
+#include "memcached.h"
+#include "jenkins_hash.h"
+#include "murmur3_hash.h"
+#include "crc32c_hash.h"
+#include "siphash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NKEYS 4096
+
+static const size_t key_lengths[] = { 8, 16, 32, 64, 128, 250 };
+#define NLENGTHS (sizeof(key_lengths) / sizeof(key_lengths[0]))
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNIT "cycles"
+static inline uint64_t ticks(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+#else
+#define UNIT "ns"
+static inline uint64_t ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/* Returns the best of a few rounds, which filters out interrupts and
+ * frequency ramp-up better than an average would. */
+static double bench(hash_func fn, char *keys, const size_t length,
+                    const int rounds, uint32_t *sink) {
+    double best = 0;
+    int r, i;
+
+    for (r = 0; r < 5; r++) {
+        uint64_t start = ticks();
+        double per_key;
+        for (i = 0; i < rounds * NKEYS; i++) {
+            *sink += fn(keys + (size_t)(i % NKEYS) * KEY_MAX_LENGTH, length, 0);
+        }
+        per_key = (double)(ticks() - start) / ((double)rounds * NKEYS);
+        if (r == 0 || per_key < best)
+            best = per_key;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const struct {
+        const char *name;
+        hash_func fn;
+    } algos[] = {
+        { "jenkins", jenkins_hash },
+        { "murmur3", murmur3_hash },
+        { "crc32c", crc32c_hash },
+        { "siphash", siphash_hash },
+    };
+    const int nalgos = sizeof(algos) / sizeof(algos[0]);
+    int rounds = argc > 1 ? atoi(argv[1]) : 100;
+    uint32_t sink = 0;
+    char *keys;
+    size_t i, l;
+    int a;
+
+    if (rounds < 1) {
+        fprintf(stderr, "usage: hash_bench [rounds]\n");
+        return EXIT_FAILURE;
+    }
+
+    keys = malloc((size_t)NKEYS * KEY_MAX_LENGTH);
+    if (keys == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    srand(time(NULL));
+    for (i = 0; i < (size_t)NKEYS * KEY_MAX_LENGTH; i++) {
+        keys[i] = 'a' + rand() % 26;
+    }
+
+    printf("crc32c: %s\n", crc32c_init() ? "sse4.2" : "table");
+    if (siphash_init() != 0)
+        return EXIT_FAILURE;
+
+    printf("%-8s", UNIT "/key");
+    for (l = 0; l < NLENGTHS; l++)
+        printf(" %8lu", (unsigned long)key_lengths[l]);
+    printf("\n");
+
+    for (a = 0; a < nalgos; a++) {
+        printf("%-8s", algos[a].name);
+        for (l = 0; l < NLENGTHS; l++) {
+            printf(" %8.1f", bench(algos[a].fn, keys, key_lengths[l],
+                                   rounds, &sink));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    free(keys);
+    /* Keep the calls from being optimized out. */
+    return sink == 0x12345678 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
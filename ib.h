@@ -25,6 +25,9 @@
 /* communication buffer size */
 #define BUF_SIZE 0x10000
 
+/* get response length for a value that doesn't fit in BUF_SIZE */
+#define GET_TOO_LARGE 0x00ffffff
+
 /*exchange data struct for connectting QPs*/
 struct qp_con_data_t{
     uint64_t addr;    /*Buffer address*/
@@ -12,7 +12,7 @@ int clear_cq(resource_t *res, int cq_flag);
 int resource_destroy(resource_t *res);
 
 int client_set(resource_t *res, char *key, uint key_len, uint data_len, char *data);
-void client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data);
+int client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data);
 void client_stop(resource_t *res);
 
 /*
@@ -50,20 +50,26 @@ encode_binary_stop(uint8_t *out)
     out[0] = OP_STOP;
 }
 
-static void
+static int
 decode_get_response(uint8_t *in, uint *data_len, uint8_t **data)
 {
     int last = 0;
     POLL_UNTIL(in[0] != 0xff);
     *data_len = (in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
     in[0] = 0xff;
+    if (*data_len == GET_TOO_LARGE) {
+        *data_len = 0;
+        *data = NULL;
+        return 1;
+    }
     if (*data_len == 0) {
         *data = NULL;
-        return;
+        return 0;
     }
     last = 5 + *data_len - 1;
     POLL_UNTIL(in[last] == in[4]);
     *data = in + 5;
+    return 0;
 }
 
 static void
@@ -93,12 +99,18 @@ int client_set(resource_t *res, char *key, uint key_len, uint data_len, char *da
 /*
   output: data_len, data
   'data' should be NULL or malloced buffer, and be freed after use
+  returns 1 if the value is too large to be sent over RDMA; data is NULL
+  then, as for a miss
  */
-void client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data)
+int client_get(resource_t *res, char *key, uint key_len, uint *data_len, uint8_t **data)
 {
+    int return_code;
     encode_binary_get(key, key_len, res->out_buf);
     rdma_request(res);
-    decode_get_response(res->in_buf, data_len, data);
+    return_code = decode_get_response(res->in_buf, data_len, data);
+    if (return_code != 0)
+      fprintf(stderr, "ERROR in client_get: value too large\n");
+    return return_code;
 }
 
 void client_stop(resource_t *res)
@@ -85,7 +85,7 @@ static int do_op_set(uint8_t *request)
 
         return 1;
     }
-    memcpy(ITEM_data(it), data, vlen);
+    item_data_write(it, 0, data, vlen);
     if (old_it != NULL) {
         item_replace(old_it, it, hv);
         do_item_remove(old_it);         /* release our reference */
@@ -106,6 +106,17 @@ static void do_op_get(uint8_t *request, uint8_t *response)
     it = item_get(key, nkey);
     if (it == 0) {
         encode_get_response(0, NULL, response);
+    } else if ((it->it_flags & ITEM_CHUNKED) || 5 + it->nbytes > BUF_SIZE) {
+        /* too big for one response buffer; tell it apart from a miss */
+        encode_get_response(GET_TOO_LARGE, NULL, response);
+        item_remove(it);
+    } else if (it->it_flags & ITEM_COUNTER) {
+        /* kept as a binary integer; send it as the ASCII clients stored */
+        char counter[INCR_MAX_STORAGE_LEN + 2];
+        int len = item_counter_ascii(it, counter);
+        memcpy(counter + len, "\r\n", 2);
+        encode_get_response(len + 2, counter, response);
+        item_remove(it);
     } else {
         encode_get_response(it->nbytes, ITEM_data(it), response);
         item_remove(it);
@@ -11,11 +11,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include <assert.h>
 
 /* Forward Declarations */
-static void item_link_q(item *it);
+static void do_item_link_q(item *it, const int lru);
+static void do_item_unlink_q(item *it);
+static void item_link_q(item *it, const int lru);
 static void item_unlink_q(item *it);
+static void lru_move(item *it, const int lru);
+static int lru_pull_tail(const unsigned int id, const int lru,
+                         const int limit, const bool to_cold,
+                         const uint32_t cur_hv);
+static void wheel_add(item *it, const uint32_t hv);
+static unsigned int wheel_count(const unsigned int id);
+static void evictor_wake(void);
+static uint64_t evictor_cpu_time(void);
+static unsigned int item_reclaim_wait(void);
+static void prefix_sweep_wake(void);
 
 /*
  * We only reposition items in the LRU queue if they haven't been repositioned
@@ -34,24 +47,351 @@ typedef struct {
     uint64_t tailrepairs;
     uint64_t expired_unfetched;
     uint64_t evicted_unfetched;
+    uint64_t moves_to_cold;
+    uint64_t moves_to_warm;
+    uint64_t clock_cleared;
+    uint64_t lfu_spared;
+    uint64_t admitted;          /* tinylfu: evictions of old items for new */
+    uint64_t rejected;          /* tinylfu: new items evicted instead */
+    uint64_t crawler_reclaimed;
+    uint64_t crawler_duration;  /* usec the last crawl of the class took */
+    uint64_t expired_freed;     /* freed by the expiry wheel */
+    uint64_t reserve_hits;      /* allocations served by the evictor's reserve */
+    uint64_t reserve_misses;    /* allocations that found it empty */
 } itemstats_t;
 
-static item *heads[LARGEST_ID];
-static item *tails[LARGEST_ID];
+static item *heads[LARGEST_ID][LRU_SEGMENTS];
+static item *tails[LARGEST_ID][LRU_SEGMENTS];
 static itemstats_t itemstats[LARGEST_ID];
-static unsigned int sizes[LARGEST_ID];
+static unsigned int sizes[LARGEST_ID][LRU_SEGMENTS];
+
+/* One lock per slab class, covering its LRUs, sizes and itemstats. The lock
+ * order is item lock, then LRU lock, then slabs_lock, and nobody holds two
+ * LRU locks at once. Initialized in thread_init(). */
+pthread_mutex_t lru_locks[LARGEST_ID];
+
+static pthread_mutex_t cas_id_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Items are stamped with the flush generation when they are linked, and
+ * flush_all starts a new one, so everything linked before is dead at once.
+ * Dead items are reclaimed when they are next seen, by an allocation, a get
+ * or the LRU crawler. Items only keep the low 16 bits; see
+ * flush_gen_bump(). */
+#define FLUSH_GEN_WALK 32768
+#define ITEM_flushed(it) ((it)->flush_gen != (uint16_t)flush_gen)
+static volatile unsigned int flush_gen = 0;
+/* When a delayed flush_all is due, or 0 */
+static volatile rel_time_t flush_pending = 0;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The item the clock hand visits after it. */
+static item *clock_next(item *it) {
+    return it->prev ? ITEM_prev(it) : tails[it->slabs_clsid][COLD_LRU];
+}
+
+/* The LRU new items are linked to. */
+#define LINK_LRU (settings.lru_segmented ? HOT_LRU : COLD_LRU)
+
+/* Hits only set ITEM_ACTIVE and leave the LRU lists alone. */
+#define HITS_MARK_ONLY (settings.lru_segmented || \
+                        settings.lru_mode == LRU_MODE_CLOCK)
+
+/* With -o lru_mode=clock, the next item of each class to look at for
+ * eviction. The hand moves from the tail of the class's list towards the
+ * head, then wraps round to the tail; NULL means the tail. Unlinking the
+ * item under the hand moves the hand on. */
+static item *clock_hand[LARGEST_ID];
+
+/* With -o lru_crawler, the next item the crawler looks at in each class, or
+ * NULL when it isn't crawling the class. Moved on like clock_hand. */
+static item *crawler_pos[LARGEST_ID];
+
+/* With -o lru_mode=lfu or tinylfu, how often each key was asked for lately:
+ * a count-min sketch of SKETCH_DEPTH rows of small counters, indexed by the
+ * key's hash. Once there have been SKETCH_SAMPLE accesses per counter of a
+ * row, all counters are halved, so popularity fades with age. Updated
+ * without locks; a lost increment only makes an estimate a little low. */
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX 15
+#define SKETCH_SAMPLE 10
+#define USE_SKETCH (settings.lru_mode == LRU_MODE_LFU || \
+                    settings.lru_mode == LRU_MODE_TINYLFU)
+static uint8_t *sketch;
+static unsigned int sketch_width;
+static unsigned int sketch_adds;
+static pthread_mutex_t sketch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The most items lru_mode=lfu spares to make room for one */
+#define LFU_SPARE_MAX 16
+
+/* Sizes the sketch for about one counter per 512 bytes of cache. */
+void item_sketch_init(void) {
+    size_t want = settings.maxbytes / 512;
+    sketch_width = 4096;
+    while (sketch_width < want && sketch_width < (1 << 24))
+        sketch_width <<= 1;
+    sketch = calloc(SKETCH_DEPTH, sketch_width);
+    if (sketch == NULL) {
+        fprintf(stderr, "Failed to allocate the frequency sketch\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline uint8_t *sketch_counter(const uint32_t hv, const int row) {
+    static const uint64_t seeds[SKETCH_DEPTH] = {
+        0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+        0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+    };
+    uint64_t h = ((uint64_t)hv + seeds[row]) * seeds[row];
+    return &sketch[row * sketch_width + ((h >> 32) & (sketch_width - 1))];
+}
+
+/* Counts a fetch of the key with hash hv, whether it's there or not, if the
+ * -o lru_mode policy wants to know. Stores don't count. */
+void item_count_fetch(const uint32_t hv) {
+    int row;
+
+    if (!USE_SKETCH)
+        return;
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        uint8_t *c = sketch_counter(hv, row);
+        if (*c < SKETCH_MAX)
+            *c = *c + 1;
+    }
+    if (++sketch_adds >= sketch_width * SKETCH_SAMPLE &&
+        pthread_mutex_trylock(&sketch_lock) == 0) {
+        if (sketch_adds >= sketch_width * SKETCH_SAMPLE) {
+            size_t i;
+            for (i = 0; i < (size_t)SKETCH_DEPTH * sketch_width; i++)
+                sketch[i] >>= 1;
+            sketch_adds = 0;
+        }
+        pthread_mutex_unlock(&sketch_lock);
+    }
+}
+
+/* About how often the key with hash hv was asked for lately. */
+static unsigned int sketch_estimate(const uint32_t hv) {
+    unsigned int min = SKETCH_MAX;
+    int row;
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        uint8_t c = *sketch_counter(hv, row);
+        if (c < min)
+            min = c;
+    }
+    return min;
+}
+
+/* Where the eviction search of class id starts; this is what sets the
+ * -o lru_mode policies apart. Items are only freed from there on if memory
+ * is short. The caller holds the class's LRU lock. */
+static item *evict_first(const unsigned int id) {
+    item *it, *victim;
+
+    switch (settings.lru_mode) {
+    case LRU_MODE_CLOCK:
+        if (clock_hand[id] != NULL)
+            return clock_hand[id];
+        break;
+    case LRU_MODE_TINYLFU:
+        /* The window (HOT) and the main LRU (COLD) each offer their oldest
+         * item. A new item only gets in if it's been asked for more than
+         * the main victim; otherwise it goes instead. */
+        it = tails[id][HOT_LRU];
+        victim = tails[id][COLD_LRU];
+        if (it == NULL || victim == NULL)
+            return victim != NULL ? victim : it;
+        if (sketch_estimate(ITEM_hv(it)) > sketch_estimate(ITEM_hv(victim)))
+            return victim;
+        return it;
+    default:
+        break;
+    }
+    return tails[id][COLD_LRU];
+}
+
 
 void item_stats_reset(void) {
-    mutex_lock(&cache_lock);
-    memset(itemstats, 0, sizeof(itemstats));
-    mutex_unlock(&cache_lock);
+    int i;
+    for (i = 0; i < LARGEST_ID; i++) {
+        mutex_lock(&lru_locks[i]);
+        memset(&itemstats[i], 0, sizeof(itemstats_t));
+        mutex_unlock(&lru_locks[i]);
+    }
 }
 
 
-/* Get the next CAS id for a new item. */
-uint64_t get_cas_id(void) {
-    static uint64_t cas_id = 0;
-    return ++cas_id;
+/* CAS ids are handed to each thread in blocks of CAS_ID_BLOCK, so linking
+ * an item only takes cas_id_lock once per block. Ids are unique but only
+ * roughly ordered between threads; get_cas_id() leaves the rest of its
+ * block behind whenever that would go below the id it has to beat. */
+#define CAS_ID_BLOCK 1024
+
+typedef struct {
+    uint64_t next;
+    uint64_t end;
+} cas_range_t;
+
+static uint64_t cas_id = 0;     /* highest id given out, under cas_id_lock */
+/* Every id from now on is above this; see item_flush_prefix(). */
+static volatile uint64_t cas_id_floor = 0;
+static pthread_key_t cas_range_key;
+static pthread_once_t cas_range_once = PTHREAD_ONCE_INIT;
+
+static void cas_range_key_init(void) {
+    pthread_key_create(&cas_range_key, free);
+}
+
+/* Takes n ids off the shared counter and returns the first one. */
+static uint64_t cas_id_reserve(const uint64_t n) {
+    uint64_t first;
+    mutex_lock(&cas_id_lock);
+    first = cas_id + 1;
+    cas_id += n;
+    mutex_unlock(&cas_id_lock);
+    return first;
+}
+
+/* Get the next CAS id for a new item. It is greater than min, which callers
+ * replacing an item pass its CAS as, so a key's CAS only ever goes up. */
+uint64_t get_cas_id(const uint64_t min) {
+    uint64_t floor = cas_id_floor > min ? cas_id_floor : min;
+    cas_range_t *range;
+
+    pthread_once(&cas_range_once, cas_range_key_init);
+    if ((range = pthread_getspecific(cas_range_key)) == NULL) {
+        range = calloc(1, sizeof(cas_range_t));
+        if (range == NULL || pthread_setspecific(cas_range_key, range) != 0) {
+            free(range);
+            return cas_id_reserve(1);
+        }
+    }
+    /* A fresh block starts above every id given out so far, floor too. */
+    if (range->next >= range->end || range->next <= floor) {
+        range->next = cas_id_reserve(CAS_ID_BLOCK);
+        range->end = range->next + CAS_ID_BLOCK;
+    }
+    return range->next++;
+}
+
+/* With flush_prefix, every item whose key starts with a flushed prefix and
+ * was linked before the flush is dead. A prefix is the part of the key before
+ * one of its settings.prefix_delimiter, like "user:1234" in "user:1234:name".
+ * Each flushed prefix records the CAS id the flush took, and items of the
+ * prefix with a lower id are dead (ids given out afterwards are all
+ * higher); like with flush_all, they are reclaimed
+ * when they are next seen, and the prefix sweep thread unlinks the rest.
+ *
+ * Entries are added under prefix_flush_lock and never freed, so gets look
+ * them up without taking it. prefix_flush_cas is the highest id still
+ * recorded, so items at or above it never need the lookup. Once the sweep
+ * has been over the whole table, the flushes it covered are dropped (their
+ * id reset to 0) and prefix_flush_cas falls back, to 0 when none are left. */
+#define PREFIX_FLUSH_HASH_SIZE 1024
+
+typedef struct _prefix_flush prefix_flush_t;
+struct _prefix_flush {
+    prefix_flush_t * volatile next;
+    volatile uint64_t cas;      /* items of the prefix below this are dead */
+    size_t nprefix;
+    char prefix[];
+};
+
+static prefix_flush_t * volatile prefix_flushes[PREFIX_FLUSH_HASH_SIZE];
+static volatile uint64_t prefix_flush_cas = 0;
+static pthread_mutex_t prefix_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static prefix_flush_t *prefix_flush_find(const char *prefix,
+                                         const size_t nprefix) {
+    prefix_flush_t *pf;
+    uint32_t hashval = hash(prefix, nprefix, 0) % PREFIX_FLUSH_HASH_SIZE;
+
+    for (pf = prefix_flushes[hashval]; pf != NULL; pf = pf->next) {
+        if (pf->nprefix == nprefix && memcmp(pf->prefix, prefix, nprefix) == 0)
+            return pf;
+    }
+    return NULL;
+}
+
+/* Flushes every item under prefix linked so far. A trailing delimiter is
+ * optional. Returns false if CAS is disabled or we're out of memory. */
+bool item_flush_prefix(const char *prefix, size_t nprefix) {
+    prefix_flush_t *pf;
+    uint64_t cas;
+
+    if (!settings.use_cas)
+        return false;
+    if (nprefix > 0 && prefix[nprefix - 1] == settings.prefix_delimiter)
+        nprefix--;
+
+    mutex_lock(&prefix_flush_lock);
+    /* Threads still holding lower ids in their blocks skip past them. */
+    cas = cas_id_reserve(1);
+    cas_id_floor = cas;
+    if ((pf = prefix_flush_find(prefix, nprefix)) == NULL) {
+        uint32_t hashval = hash(prefix, nprefix, 0) % PREFIX_FLUSH_HASH_SIZE;
+        if ((pf = malloc(sizeof(prefix_flush_t) + nprefix)) == NULL) {
+            mutex_unlock(&prefix_flush_lock);
+            return false;
+        }
+        memcpy(pf->prefix, prefix, nprefix);
+        pf->nprefix = nprefix;
+        pf->cas = cas;
+        pf->next = prefix_flushes[hashval];
+        /* The entry has to be complete before gets can find it. */
+#ifdef HAVE_GCC_ATOMICS
+        __sync_synchronize();
+#endif
+        prefix_flushes[hashval] = pf;
+    } else {
+        pf->cas = cas;
+    }
+    prefix_flush_cas = cas;
+    mutex_unlock(&prefix_flush_lock);
+    prefix_sweep_wake();
+    return true;
+}
+
+/* Drops the flushes with ids up to covered, once no item they killed is
+ * left linked. */
+static void prefix_flush_expire(const uint64_t covered) {
+    prefix_flush_t *pf;
+    uint64_t highest = 0;
+    int i;
+
+    mutex_lock(&prefix_flush_lock);
+    for (i = 0; i < PREFIX_FLUSH_HASH_SIZE; i++) {
+        for (pf = prefix_flushes[i]; pf != NULL; pf = pf->next) {
+            if (pf->cas <= covered)
+                pf->cas = 0;
+            if (pf->cas > highest)
+                highest = pf->cas;
+        }
+    }
+    prefix_flush_cas = highest;
+    mutex_unlock(&prefix_flush_lock);
+}
+
+/* True if it was linked before a flush_prefix of one of its prefixes. */
+static bool item_prefix_flushed(item *it) {
+    uint64_t cas = ITEM_get_cas(it);
+    const char *key = ITEM_key(it);
+    prefix_flush_t *pf;
+    int i;
+
+    if (cas >= prefix_flush_cas)
+        return false;
+    for (i = 0; i < it->nkey; i++) {
+        if (key[i] == settings.prefix_delimiter &&
+            (pf = prefix_flush_find(key, i)) != NULL && cas < pf->cas)
+            return true;
+    }
+    return false;
+}
+
+/* Dead by flush_all or flush_prefix. */
+static inline bool item_is_flushed(item *it) {
+    return ITEM_flushed(it) || item_prefix_flushed(it);
 }
 
 /* Enable this for reference-count debugging. */
@@ -68,51 +408,124 @@ uint64_t get_cas_id(void) {
 /**
  * Generates the variable-sized part of the header for an object.
  *
- * key     - The key
  * nkey    - The length of the key
  * flags   - key flags
  * nbytes  - Number of bytes to hold value and addition CRLF terminator
- * suffix  - Buffer for the "VALUE" line suffix (flags, size).
- * nsuffix - The length of the suffix is stored here.
  *
  * Returns the total size of the header.
  */
-static size_t item_make_header(const uint8_t nkey, const int flags, const int nbytes,
-                     char *suffix, uint8_t *nsuffix) {
-    /* suffix is defined at 40 chars elsewhere.. */
-    *nsuffix = (uint8_t) snprintf(suffix, 40, " %d %d\r\n", flags, nbytes - 2);
-    return sizeof(item) + nkey + *nsuffix + nbytes;
+static size_t item_make_header(const uint8_t nkey, const int flags, const int nbytes) {
+    return sizeof(item) + nkey + (flags != 0 ? sizeof(uint32_t) : 0) + nbytes;
 }
 
-/*@null@*/
-item *do_item_alloc(char *key, const size_t nkey, const int flags,
-                    const rel_time_t exptime, const int nbytes,
-                    const uint32_t cur_hv) {
-    uint8_t nsuffix;
-    item *it = NULL;
-    char suffix[40];
-    size_t ntotal = item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
-    if (settings.use_cas) {
-        ntotal += sizeof(uint64_t);
+/* The link to a chunked item's first chunk, at the start of its data. */
+static item *item_first_chunk(item *it) {
+    item_ref_t ref;
+    memcpy(&ref, ITEM_data(it), sizeof(ref));
+    return ITEM_ptr(ref);
+}
+
+static void item_set_first_chunk(item *it, item *chunk) {
+    item_ref_t ref = ITEM_ref(chunk);
+    memcpy(ITEM_data(it), &ref, sizeof(ref));
+}
+
+/* How much of its value a chunked item holds itself. */
+static int item_inline_bytes(item *it) {
+    return settings.slab_chunk_max - (ITEM_data(it) - (char *)it)
+        - sizeof(item_ref_t);
+}
+
+/* With -o epoch_reclaim, an item taken off the tail may still be read by
+ * a GET, so rather than reusing it this unlinks and retires it, dropping
+ * the caller's reference, and allocates from what earlier retirements gave
+ * back. Returns NULL if nothing could be reclaimed yet; retiring more items
+ * wouldn't help then, as none of them is freed before this one. The
+ * caller holds the LRU lock of class id and the item lock for hv. */
+static item *do_item_alloc_retire(item *search, const uint32_t hv,
+                                  const size_t ntotal, const unsigned int id) {
+    do_item_unlink_nolock(search, hv);
+    do_item_remove(search);
+    item_reclaim();
+    return slabs_alloc(ntotal, id);
+}
+
+/* Unlinks search, which the caller holds a reference to, and returns it to
+ * be reused for an item of ntotal bytes. An optimistic reader may have
+ * taken a reference before the unlink changed the chain's sequence, and
+ * then still sends it; if ours isn't left as the only one, the last reader
+ * frees it and this returns NULL. The caller holds the LRU lock of the
+ * item's class and the item lock for hv. */
+static item *do_item_alloc_reuse(item *search, const uint32_t hv,
+                                 const size_t ntotal) {
+    do_item_unlink_nolock(search, hv);
+    /* The unlink's sequence bump is a full barrier: a reader that takes a
+     * reference after this check fails its own check and drops it again. */
+    if (*(volatile unsigned short *)&search->refcount != 1) {
+        do_item_remove(search);
+        return NULL;
     }
+    slabs_adjust_mem_requested(search->slabs_clsid, ITEM_ntotal(search), ntotal);
+    if (search->it_flags & ITEM_CHUNKED)
+        item_free_chunks(search);
+    /* Initialize the item block: */
+    search->slabs_clsid = 0;
+    return search;
+}
 
-    unsigned int id = slabs_clsid(ntotal);
-    if (id == 0)
-        return 0;
+/* Gets ntotal bytes of class id for a new item, evicting if it has to. The
+ * item comes back with a reference and no links. With lru_mode=lfu, items
+ * asked for more often than freq, the new item's count, are spared. With
+ * evict, the freelist is left alone and the chunk always comes from the
+ * LRU; the background evictor uses that to refill it.
+ */
+/*@null@*/
+static item *do_item_alloc_pull(const size_t ntotal, const unsigned int id,
+                                const uint32_t cur_hv,
+                                const unsigned int freq, const bool evict) {
+    item *it = NULL;
 
-    mutex_lock(&cache_lock);
+    mutex_lock(&lru_locks[id]);
     /* do a quick check if we have any expired items in the tail.. */
     int tries = 5;
-    int tried_alloc = 0;
-    item *search;
+    int tried_alloc = evict;
+    item *search, *next_search;
     void *hold_lock = NULL;
-    rel_time_t oldest_live = settings.oldest_live;
+    /* Clock and LFU pass over at most one lap of items they spare. */
+    unsigned int sweep = sizes[id][COLD_LRU];
+    if (settings.lru_mode == LRU_MODE_LFU && sweep > LFU_SPARE_MAX)
+        sweep = LFU_SPARE_MAX;
+
+    /* The evictor keeps free chunks in reserve, so take one of those
+     * before looking at the tail at all. */
+    if (settings.evict_reserve > 0 && !evict) {
+        tried_alloc = 1;
+        if ((it = slabs_alloc(ntotal, id)) != NULL) {
+            itemstats[id].reserve_hits++;
+        } else {
+            itemstats[id].reserve_misses++;
+            evictor_wake();
+        }
+    }
 
-    search = tails[id];
+    /* Evictions only come from COLD. If the maintainer hasn't put anything
+     * there yet, do it now. */
+    if (it == NULL && settings.lru_segmented && tails[id][COLD_LRU] == NULL) {
+        if (lru_pull_tail(id, HOT_LRU, tries, true, cur_hv) == 0)
+            lru_pull_tail(id, WARM_LRU, tries, true, cur_hv);
+    }
+
+    search = it == NULL ? evict_first(id) : NULL;
     /* We walk up *only* for locked items. Never searching for expired.
      * Waste of CPU for almost all deployments */
-    for (; tries > 0 && search != NULL; tries--, search=search->prev) {
-        uint32_t hv = hash(ITEM_key(search), search->nkey, 0);
+    for (; tries > 0 && search != NULL; tries--, search=next_search) {
+        uint32_t hv = ITEM_hv(search);
+        if (settings.lru_mode == LRU_MODE_CLOCK) {
+            next_search = clock_next(search);
+        } else {
+            /* search may move to another LRU below */
+            next_search = ITEM_prev(search);
+        }
         /* Attempt to hash item lock the "search" item. If locked, no
          * other callers can incr the refcount
          */
@@ -137,20 +550,69 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
 
         /* Expired or flushed */
         if ((search->exptime != 0 && search->exptime < current_time)
-            || (search->time <= oldest_live && oldest_live <= current_time)) {
+            || item_is_flushed(search)) {
             itemstats[id].reclaimed++;
             if ((search->it_flags & ITEM_FETCHED) == 0) {
                 itemstats[id].expired_unfetched++;
             }
-            it = search;
-            slabs_adjust_mem_requested(it->slabs_clsid, ITEM_ntotal(it), ntotal);
-            do_item_unlink_nolock(it, hv);
-            /* Initialize the item block: */
-            it->slabs_clsid = 0;
-        } else if ((it = slabs_alloc(ntotal, id)) == NULL) {
+            if (settings.epoch_reclaim) {
+                it = do_item_alloc_retire(search, hv, ntotal, id);
+                if (hold_lock)
+                    item_trylock_unlock(hold_lock);
+                /* it may be search's memory again */
+                search = NULL;
+                tried_alloc = 1;
+                break;
+            }
+            if ((it = do_item_alloc_reuse(search, hv, ntotal)) == NULL) {
+                if (hold_lock)
+                    item_trylock_unlock(hold_lock);
+                hold_lock = NULL;
+                continue;
+            }
+        } else if (settings.lru_segmented &&
+                   (search->it_flags & ITEM_ACTIVE) != 0) {
+            /* Fetched since it went cold; the maintainer hasn't got to it
+             * yet. Bump it to WARM instead of evicting it. */
+            lru_move(search, WARM_LRU);
+            refcount_decr(&search->refcount);
+            if (hold_lock)
+                item_trylock_unlock(hold_lock);
+            continue;
+        } else if (tried_alloc || (it = slabs_alloc(ntotal, id)) == NULL) {
             tried_alloc = 1;
             if (settings.evict_to_free == 0) {
                 itemstats[id].outofmemory++;
+            } else if (settings.lru_mode == LRU_MODE_CLOCK &&
+                       (search->it_flags & ITEM_ACTIVE) != 0 && sweep > 0) {
+                /* Fetched since the hand last came by: clear the bit and
+                 * give it another lap. This doesn't use up a try. */
+                sweep--;
+                item_flags_clear(search, ITEM_ACTIVE);
+                clock_hand[id] = next_search;
+                itemstats[id].clock_cleared++;
+                refcount_decr(&search->refcount);
+                if (hold_lock)
+                    item_trylock_unlock(hold_lock);
+                tries++;
+                continue;
+            } else if (settings.lru_mode == LRU_MODE_LFU && sweep > 0 &&
+                       sketch_estimate(hv) > freq) {
+                /* Asked for more than the new item: send it round again.
+                 * This doesn't use up a try either. */
+                sweep--;
+                do_item_unlink_q(search);
+                do_item_link_q(search, COLD_LRU);
+                itemstats[id].lfu_spared++;
+                refcount_decr(&search->refcount);
+                if (hold_lock)
+                    item_trylock_unlock(hold_lock);
+                tries++;
+                continue;
+            } else if (settings.epoch_reclaim && item_reclaim() > 0 &&
+                       (it = slabs_alloc(ntotal, id)) != NULL) {
+                /* Something retired earlier could be given back after
+                 * all; that beats retiring another item. */
             } else {
                 itemstats[id].evicted++;
                 itemstats[id].evicted_time = current_time - search->time;
@@ -159,11 +621,28 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
                 if ((search->it_flags & ITEM_FETCHED) == 0) {
                     itemstats[id].evicted_unfetched++;
                 }
-                it = search;
-                slabs_adjust_mem_requested(it->slabs_clsid, ITEM_ntotal(it), ntotal);
-                do_item_unlink_nolock(it, hv);
-                /* Initialize the item block: */
-                it->slabs_clsid = 0;
+                if (settings.lru_mode == LRU_MODE_TINYLFU) {
+                    if (ITEM_lru(search) == HOT_LRU) {
+                        itemstats[id].rejected++;
+                    } else {
+                        itemstats[id].admitted++;
+                    }
+                }
+                if (settings.epoch_reclaim) {
+                    it = do_item_alloc_retire(search, hv, ntotal, id);
+                    if (hold_lock)
+                        item_trylock_unlock(hold_lock);
+                    /* it may be search's memory again */
+                    search = NULL;
+                    tried_alloc = 1;
+                    break;
+                }
+                if ((it = do_item_alloc_reuse(search, hv, ntotal)) == NULL) {
+                    if (hold_lock)
+                        item_trylock_unlock(hold_lock);
+                    hold_lock = NULL;
+                    continue;
+                }
 
                 /* If we've just evicted an item, and the automover is set to
                  * angry bird mode, attempt to rip memory into this slab class.
@@ -177,7 +656,9 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
             }
         }
 
-        refcount_decr(&search->refcount);
+        /* A reclaimed or evicted item keeps our reference for the caller */
+        if (it != search)
+            refcount_decr(&search->refcount);
         /* If hash values were equal, we don't grab a second lock */
         if (hold_lock)
             item_trylock_unlock(hold_lock);
@@ -186,41 +667,412 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
 
     if (!tried_alloc && (tries == 0 || search == NULL))
         it = slabs_alloc(ntotal, id);
+    /* What earlier evictions retired may be free by now, or once the GETs
+     * in progress are done. Other allocations needn't wait for that. A
+     * caller holding an item lock (cur_hv) would stall the GETs on it, and
+     * with them the reclaim, so it doesn't wait. */
+    if (it == NULL && settings.epoch_reclaim) {
+        mutex_unlock(&lru_locks[id]);
+        if ((cur_hv == 0 ? item_reclaim_wait() : item_reclaim()) > 0)
+            it = slabs_alloc(ntotal, id);
+        mutex_lock(&lru_locks[id]);
+    }
 
     if (it == NULL) {
-        itemstats[id].outofmemory++;
-        mutex_unlock(&cache_lock);
+        if (!evict)
+            itemstats[id].outofmemory++;
+        mutex_unlock(&lru_locks[id]);
         return NULL;
     }
 
     assert(it->slabs_clsid == 0);
-    assert(it != heads[id]);
 
     /* Item initialization can happen outside of the lock; the item's already
      * been removed from the slab LRU.
      */
-    it->refcount = 1;     /* the caller will have a reference */
-    mutex_unlock(&cache_lock);
+    if (it != search)
+        it->refcount = 1;     /* the caller will have a reference */
+    mutex_unlock(&lru_locks[id]);
     it->next = it->prev = it->h_next = 0;
     it->slabs_clsid = id;
+    return it;
+}
+
+/* Gets the chunks for the part of a chunked item's value it doesn't hold
+ * itself. Full chunks come from the largest class, the last one from the
+ * class that fits it best. Returns false if memory ran out; the chunks got
+ * so far stay linked for item_free to give back.
+ */
+static bool do_item_alloc_chunks(item *it, const uint32_t hv,
+                                 const uint32_t cur_hv,
+                                 const unsigned int freq) {
+    const unsigned int largest = slabs_clsid(settings.slab_chunk_max);
+    const int chunk_max = settings.slab_chunk_max - sizeof(item) - 1;
+    int left = it->nbytes - item_inline_bytes(it);
+    item *last = it;
+
+    while (left > 0) {
+        int size = left < chunk_max ? left : chunk_max;
+        size_t ntotal = sizeof(item) + 1 + size;
+        unsigned int id = slabs_clsid(ntotal);
+        item *chunk = do_item_alloc_pull(ntotal, id, cur_hv, freq, false);
+        if (chunk == NULL && id != largest)
+            chunk = do_item_alloc_pull(ntotal, largest, cur_hv, freq, false);
+        if (chunk == NULL)
+            return false;
+
+        chunk->nkey = 0;
+        chunk->nbytes = size;
+        chunk->exptime = hv;
+        ITEM_set_prev(chunk, it);
+        /* Last, so the slab mover never sees a chunk without its item */
+        chunk->it_flags = ITEM_CHUNK;
+        if (last == it) {
+            item_set_first_chunk(it, chunk);
+        } else {
+            ITEM_set_next(last, chunk);
+        }
+        last = chunk;
+        left -= size;
+    }
+    return true;
+}
+
+/* With grow, the item is taken from the class above the one it fits in,
+ * if there is one and it isn't chunked, so that it can later be appended
+ * to in place. */
+static item *do_item_alloc_class(char *key, const size_t nkey, const int flags,
+                                 const rel_time_t exptime, const int nbytes,
+                                 const uint32_t cur_hv, const bool grow) {
+    item *it;
+    size_t ntotal = item_make_header(nkey + 1, flags, nbytes);
+    bool chunked;
+    unsigned int id;
+    unsigned int freq = 0;
+    if (settings.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+
+    chunked = ntotal > settings.slab_chunk_max;
+    if (ntotal > settings.item_size_max)
+        return 0;
+    id = slabs_clsid(chunked ? settings.slab_chunk_max : ntotal);
+    if (id == 0)
+        return 0;
+    if (grow && !chunked && id < slabs_clsid(settings.slab_chunk_max))
+        id++;
+
+    if (settings.lru_mode == LRU_MODE_LFU)
+        freq = sketch_estimate(cur_hv ? cur_hv : hash(key, nkey, 0));
+    it = do_item_alloc_pull(chunked ? settings.slab_chunk_max : ntotal, id,
+                            cur_hv, freq, false);
+    if (it == NULL)
+        return NULL;
 
     DEBUG_REFCNT(it, '*');
-    it->it_flags = settings.use_cas ? ITEM_CAS : 0;
+    it->it_flags = (settings.use_cas ? ITEM_CAS : 0) |
+                   (flags != 0 ? ITEM_CFLAGS : 0);
     it->nkey = nkey;
+    /* cur_hv is the hash of key whenever the caller holds its item lock */
+#ifndef COMPACT_ITEMS
+    it->hv = cur_hv ? cur_hv : hash(key, nkey, 0);
+#endif
     it->nbytes = nbytes;
     memcpy(ITEM_key(it), key, nkey);
     it->exptime = exptime;
-    memcpy(ITEM_suffix(it), suffix, (size_t)nsuffix);
-    it->nsuffix = nsuffix;
+    if (flags != 0)
+        memcpy(ITEM_suffix(it), &flags, sizeof(uint32_t));
+
+    if (chunked) {
+        item_set_first_chunk(it, NULL);
+        it->it_flags |= ITEM_CHUNKED;
+        if (!do_item_alloc_chunks(it, cur_hv ? cur_hv : hash(key, nkey, 0),
+                                  cur_hv, freq)) {
+            do_item_remove(it);
+            return NULL;
+        }
+    }
     return it;
 }
 
+/*@null@*/
+item *do_item_alloc(char *key, const size_t nkey, const int flags,
+                    const rel_time_t exptime, const int nbytes,
+                    const uint32_t cur_hv) {
+    return do_item_alloc_class(key, nkey, flags, exptime, nbytes, cur_hv,
+                               false);
+}
+
+/*@null@*/
+item *do_item_alloc_grow(char *key, const size_t nkey, const int flags,
+                         const rel_time_t exptime, const int nbytes,
+                         const uint32_t cur_hv) {
+    return do_item_alloc_class(key, nkey, flags, exptime, nbytes, cur_hv,
+                               true);
+}
+
+/* Gives back the chunks of a chunked item. A chunk can still have a stray
+ * reference from an optimistic reader that found its slot as an item
+ * before; the reader frees it then. */
+void item_free_chunks(item *it) {
+    item *chunk = item_first_chunk(it);
+
+    item_set_first_chunk(it, NULL);
+    while (chunk != NULL) {
+        item *next = ITEM_next(chunk);
+        chunk->it_flags = 0;
+        chunk->next = chunk->prev = 0;
+        if (refcount_decr(&chunk->refcount) == 0)
+            item_free(chunk);
+        chunk = next;
+    }
+}
+
+/* Steps through the value of it one contiguous segment at a time: pass NULL
+ * as seg to start, then the segment returned last. Sets *data and *len to
+ * the segment's bytes; returns NULL past the end. A value that isn't
+ * chunked is a single segment. */
+item *item_data_seg(item *it, item *seg, char **data, int *len) {
+    if (seg == NULL) {
+        seg = it;
+        if (it->it_flags & ITEM_CHUNKED) {
+            *data = ITEM_data(it) + sizeof(item_ref_t);
+            *len = item_inline_bytes(it);
+            return seg;
+        }
+    } else if (seg == it) {
+        if ((it->it_flags & ITEM_CHUNKED) == 0)
+            return NULL;
+        seg = item_first_chunk(it);
+    } else {
+        seg = ITEM_next(seg);
+    }
+    if (seg != NULL) {
+        *data = ITEM_data(seg);
+        *len = seg->nbytes;
+    }
+    return seg;
+}
+
+/* Copies len bytes between buf and it's value at off, either way. */
+static void item_data_io(item *it, int off, char *buf, int len,
+                         const bool write) {
+    item *seg = NULL;
+    char *data;
+    int seglen;
+
+    while (len > 0 && (seg = item_data_seg(it, seg, &data, &seglen)) != NULL) {
+        int n;
+        if (off >= seglen) {
+            off -= seglen;
+            continue;
+        }
+        n = seglen - off < len ? seglen - off : len;
+        if (write) {
+            memcpy(data + off, buf, n);
+        } else {
+            memcpy(buf, data + off, n);
+        }
+        buf += n;
+        len -= n;
+        off = 0;
+    }
+}
+
+void item_data_read(item *it, int off, char *dst, int len) {
+    item_data_io(it, off, dst, len, false);
+}
+
+void item_data_write(item *it, int off, const char *src, int len) {
+    item_data_io(it, off, (char *)src, len, true);
+}
+
+/* Copies the first len bytes of src's value into dst's at off. */
+void item_data_copy(item *dst, int off, item *src, int len) {
+    item *seg = NULL;
+    char *data;
+    int seglen;
+
+    while (len > 0 && (seg = item_data_seg(src, seg, &data, &seglen)) != NULL) {
+        if (seglen > len)
+            seglen = len;
+        item_data_write(dst, off, data, seglen);
+        off += seglen;
+        len -= seglen;
+    }
+}
+
+/* Writes the value of native counter it as ASCII into buf, which holds
+ * INCR_MAX_STORAGE_LEN bytes, and returns its length. */
+int item_counter_ascii(item *it, char *buf) {
+    return snprintf(buf, INCR_MAX_STORAGE_LEN, "%llu",
+                    (unsigned long long)item_counter_get(it));
+}
+
+/* Length of the value of it as clients see it, without the CRLF. */
+int item_value_length(item *it) {
+    char buf[INCR_MAX_STORAGE_LEN];
+    if (it->it_flags & ITEM_COUNTER)
+        return item_counter_ascii(it, buf);
+    return it->nbytes - 2;
+}
+
+/* Memory held by it, chunks included. */
+static size_t item_total_bytes(item *it) {
+    size_t total = ITEM_ntotal(it);
+    item *seg = it;
+    char *data;
+    int len;
+
+    if (it->it_flags & ITEM_CHUNKED) {
+        while ((seg = item_data_seg(it, seg, &data, &len)) != NULL)
+            total += ITEM_ntotal(seg);
+    }
+    return total;
+}
+
+/*
+ * With -o epoch_reclaim, workers send items to GET clients without holding a
+ * reference on them, so an item whose last reference is dropped may still be
+ * read. item_free() then retires it to the limbo list instead, tagged with an
+ * epoch in its exptime, and item_reclaim() gives it back to the slabs once
+ * every worker has left the epochs it could have been found in. Items are
+ * retired oldest first, linked through next.
+ */
+static pthread_mutex_t limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Held by the thread running item_reclaim(); others don't wait for it */
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static item *limbo_head = NULL;
+static item *limbo_tail = NULL;
+static uint64_t limbo_items = 0;
+static uint64_t limbo_reclaimed = 0;
+
+/* Retired items to gather before item_free() tries to reclaim some. */
+#define LIMBO_BATCH 64
+
+/* How often and how many microseconds apart item_reclaim_wait() tries. */
+#define RECLAIM_WAIT_TRIES 20
+#define RECLAIM_WAIT_SLEEP 500
+
+static void item_free_now(item *it);
+
+/* Queues it in a new epoch. The caller holds limbo_lock. */
+static void limbo_append(item *it) {
+    it->exptime = epoch_advance();
+    ITEM_set_next(it, NULL);
+    if (limbo_head == NULL) {
+        limbo_head = it;
+    } else {
+        ITEM_set_next(limbo_tail, it);
+    }
+    limbo_tail = it;
+    limbo_items++;
+}
+
+static void item_retire(item *it) {
+    bool reclaim;
+
+    mutex_lock(&limbo_lock);
+    /* A reader that pinned it dropped the last reference: it's waiting
+     * already. */
+    if (it->it_flags & ITEM_RETIRED) {
+        mutex_unlock(&limbo_lock);
+        return;
+    }
+    item_flags_set(it, ITEM_RETIRED);
+    limbo_append(it);
+    reclaim = limbo_items >= LIMBO_BATCH;
+    mutex_unlock(&limbo_lock);
+
+    if (reclaim)
+        item_reclaim();
+}
+
+/* Frees the retired items no worker can still be reading. Returns how many
+ * it freed; 0 too if another thread is already at it. */
+unsigned int item_reclaim(void) {
+    item *it, *done = NULL;
+    uint32_t oldest;
+    unsigned int freed = 0;
+
+    if (pthread_mutex_trylock(&reclaim_lock) != 0)
+        return 0;
+    oldest = epoch_oldest();
+    mutex_lock(&limbo_lock);
+    while ((it = limbo_head) != NULL && EPOCH_BEFORE(it->exptime, oldest)) {
+        limbo_head = ITEM_next(it);
+        limbo_items--;
+        if (it->refcount != 0) {
+            /* Pinned by a reader (see conn_pin_items()): wait again, as
+             * freeing it is up to us once that reference is dropped. */
+            limbo_append(it);
+            continue;
+        }
+        ITEM_set_next(it, done);
+        done = it;
+    }
+    mutex_unlock(&limbo_lock);
+
+    /* ITEM_RETIRED stays set, keeping the slab mover away until the slab
+     * code marks it free. */
+    while ((it = done) != NULL) {
+        done = ITEM_next(it);
+        item_free_now(it);
+        freed++;
+    }
+
+    if (freed > 0) {
+        mutex_lock(&limbo_lock);
+        limbo_reclaimed += freed;
+        mutex_unlock(&limbo_lock);
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+    return freed;
+}
+
+/* Like item_reclaim(), but if retired items are waiting for workers to
+ * leave their epochs, gives those a little time to do so. Workers only
+ * stay in an epoch while they handle a GET, so that doesn't take long. */
+static unsigned int item_reclaim_wait(void) {
+    unsigned int freed;
+    int tries;
+
+    for (tries = 0; tries < RECLAIM_WAIT_TRIES; tries++) {
+        if ((freed = item_reclaim()) > 0)
+            return freed;
+        mutex_lock(&limbo_lock);
+        freed = limbo_items;
+        mutex_unlock(&limbo_lock);
+        if (freed == 0)
+            break;
+        usleep(RECLAIM_WAIT_SLEEP);
+    }
+    return 0;
+}
+
+void item_limbo_stats(uint64_t *waiting, uint64_t *reclaimed) {
+    mutex_lock(&limbo_lock);
+    *waiting = limbo_items;
+    *reclaimed = limbo_reclaimed;
+    mutex_unlock(&limbo_lock);
+}
+
 void item_free(item *it) {
+    if (settings.epoch_reclaim) {
+        item_retire(it);
+        return;
+    }
+    item_free_now(it);
+}
+
+static void item_free_now(item *it) {
     size_t ntotal = ITEM_ntotal(it);
     unsigned int clsid;
+    if (it->it_flags & ITEM_CHUNKED)
+        item_free_chunks(it);
     assert((it->it_flags & ITEM_LINKED) == 0);
-    assert(it != heads[it->slabs_clsid]);
-    assert(it != tails[it->slabs_clsid]);
+    assert(it != heads[it->slabs_clsid][ITEM_lru(it)]);
+    assert(it != tails[it->slabs_clsid][ITEM_lru(it)]);
     assert(it->refcount == 0);
 
     /* so slab size changer can tell later if item is already free or not */
@@ -235,113 +1087,258 @@ void item_free(item *it) {
  * the maximum for a cache entry.)
  */
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
-    char prefix[40];
-    uint8_t nsuffix;
-
-    size_t ntotal = item_make_header(nkey + 1, flags, nbytes,
-                                     prefix, &nsuffix);
+    size_t ntotal = item_make_header(nkey + 1, flags, nbytes);
     if (settings.use_cas) {
         ntotal += sizeof(uint64_t);
     }
 
-    return slabs_clsid(ntotal) != 0;
+    return ntotal <= settings.item_size_max;
 }
 
-static void item_link_q(item *it) { /* item is the new head */
+static void do_item_link_q(item *it, const int lru) { /* item is the new head */
     item **head, **tail;
     assert(it->slabs_clsid < LARGEST_ID);
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
-    head = &heads[it->slabs_clsid];
-    tail = &tails[it->slabs_clsid];
+    it->it_flags = (it->it_flags & ~ITEM_LRU_MASK) | (lru << ITEM_LRU_SHIFT);
+    head = &heads[it->slabs_clsid][lru];
+    tail = &tails[it->slabs_clsid][lru];
     assert(it != *head);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
     it->prev = 0;
-    it->next = *head;
-    if (it->next) it->next->prev = it;
+    ITEM_set_next(it, *head);
+    if (it->next) ITEM_set_prev(ITEM_next(it), it);
     *head = it;
     if (*tail == 0) *tail = it;
-    sizes[it->slabs_clsid]++;
+    sizes[it->slabs_clsid][lru]++;
     return;
 }
 
-static void item_unlink_q(item *it) {
+static void do_item_unlink_q(item *it) {
     item **head, **tail;
+    int lru = ITEM_lru(it);
     assert(it->slabs_clsid < LARGEST_ID);
-    head = &heads[it->slabs_clsid];
-    tail = &tails[it->slabs_clsid];
+    if (clock_hand[it->slabs_clsid] == it)
+        clock_hand[it->slabs_clsid] = ITEM_prev(it);
+    if (crawler_pos[it->slabs_clsid] == it)
+        crawler_pos[it->slabs_clsid] = ITEM_prev(it);
+    head = &heads[it->slabs_clsid][lru];
+    tail = &tails[it->slabs_clsid][lru];
 
     if (*head == it) {
         assert(it->prev == 0);
-        *head = it->next;
+        *head = ITEM_next(it);
     }
     if (*tail == it) {
         assert(it->next == 0);
-        *tail = it->prev;
+        *tail = ITEM_prev(it);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_next(it) != it);
+    assert(ITEM_prev(it) != it);
 
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
-    sizes[it->slabs_clsid]--;
+    if (it->next) ITEM_next(it)->prev = it->prev;
+    if (it->prev) ITEM_prev(it)->next = it->next;
+    sizes[it->slabs_clsid][lru]--;
     return;
 }
 
-int do_item_link(item *it, const uint32_t hv) {
+static void item_link_q(item *it, const int lru) {
+    mutex_lock(&lru_locks[it->slabs_clsid]);
+    do_item_link_q(it, lru);
+    mutex_unlock(&lru_locks[it->slabs_clsid]);
+}
+
+static void item_unlink_q(item *it) {
+    mutex_lock(&lru_locks[it->slabs_clsid]);
+    do_item_unlink_q(it);
+    mutex_unlock(&lru_locks[it->slabs_clsid]);
+}
+
+/* Requeues a linked item at the head of lru, clearing ITEM_ACTIVE. The
+ * caller holds the class's LRU lock and the item's lock. */
+static void lru_move(item *it, const int lru) {
+    do_item_unlink_q(it);
+    item_flags_clear(it, ITEM_ACTIVE);
+    do_item_link_q(it, lru);
+    if (lru == COLD_LRU) {
+        itemstats[it->slabs_clsid].moves_to_cold++;
+    } else if (lru == WARM_LRU) {
+        itemstats[it->slabs_clsid].moves_to_warm++;
+    }
+}
+
+/*
+ * Works through up to limit items at the tail of one LRU of class id:
+ *  - expired or flushed items nobody holds are unlinked,
+ *  - HOT and WARM items go to WARM if they were fetched since they were last
+ *    moved, and to COLD otherwise,
+ *  - on COLD, fetched items are bumped to WARM; we stop at the first one
+ *    that wasn't, as that one is next in line for eviction.
+ * With to_cold, HOT and WARM items go to COLD regardless, for an allocation
+ * that needs something to evict. Items whose lock is busy are skipped.
+ *
+ * Returns the number of items moved or unlinked. The caller holds the LRU
+ * lock of class id, and the item lock for cur_hv if that's nonzero.
+ */
+static int lru_pull_tail(const unsigned int id, const int lru,
+                         const int limit, const bool to_cold,
+                         const uint32_t cur_hv) {
+    item *search, *prev;
+    int tries = limit;
+    int done = 0;
+
+    for (search = tails[id][lru]; tries > 0 && search != NULL;
+         tries--, search = prev) {
+        uint32_t hv = ITEM_hv(search);
+        void *hold_lock = NULL;
+
+        prev = ITEM_prev(search);
+        if (hv != cur_hv && (hold_lock = item_trylock(hv)) == NULL)
+            continue;
+
+        if ((search->exptime != 0 && search->exptime < current_time)
+            || item_is_flushed(search)) {
+            /* Only ours and the link's reference: nobody is using it. */
+            if (refcount_incr(&search->refcount) == 2) {
+                itemstats[id].reclaimed++;
+                if ((search->it_flags & ITEM_FETCHED) == 0)
+                    itemstats[id].expired_unfetched++;
+                do_item_unlink_nolock(search, hv);
+                do_item_remove(search);
+                done++;
+            } else {
+                refcount_decr(&search->refcount);
+            }
+        } else if (lru == COLD_LRU) {
+            if ((search->it_flags & ITEM_ACTIVE) == 0) {
+                if (hold_lock)
+                    item_trylock_unlock(hold_lock);
+                break;
+            }
+            lru_move(search, WARM_LRU);
+            done++;
+        } else {
+            if (!to_cold && (search->it_flags & ITEM_ACTIVE) != 0) {
+                lru_move(search, WARM_LRU);
+            } else {
+                lru_move(search, COLD_LRU);
+            }
+            done++;
+        }
+
+        if (hold_lock)
+            item_trylock_unlock(hold_lock);
+    }
+    return done;
+}
+
+/* Links it with a CAS above min_cas. */
+static int do_item_link_cas(item *it, const uint32_t hv,
+                            const uint64_t min_cas) {
     MEMCACHED_ITEM_LINK(ITEM_key(it), it->nkey, it->nbytes);
     assert((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == 0);
-    mutex_lock(&cache_lock);
     it->it_flags |= ITEM_LINKED;
     it->time = current_time;
+    it->flush_gen = flush_gen;
 
     STATS_LOCK();
-    stats.curr_bytes += ITEM_ntotal(it);
+    stats.curr_bytes += item_total_bytes(it);
     stats.curr_items += 1;
     stats.total_items += 1;
     STATS_UNLOCK();
 
     /* Allocate a new CAS ID on link. */
-    ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
+    ITEM_set_cas(it, (settings.use_cas) ? get_cas_id(min_cas) : 0);
     assoc_insert(it, hv);
-    item_link_q(it);
+    item_link_q(it, LINK_LRU);
     refcount_incr(&it->refcount);
-    mutex_unlock(&cache_lock);
+    wheel_add(it, hv);
 
     return 1;
 }
 
+int do_item_link(item *it, const uint32_t hv) {
+    return do_item_link_cas(it, hv, 0);
+}
+
 void do_item_unlink(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UNLINK(ITEM_key(it), it->nkey, it->nbytes);
-    mutex_lock(&cache_lock);
     if ((it->it_flags & ITEM_LINKED) != 0) {
         it->it_flags &= ~ITEM_LINKED;
         STATS_LOCK();
-        stats.curr_bytes -= ITEM_ntotal(it);
+        stats.curr_bytes -= item_total_bytes(it);
         stats.curr_items -= 1;
         STATS_UNLOCK();
         assoc_delete(ITEM_key(it), it->nkey, hv);
         item_unlink_q(it);
         do_item_remove(it);
     }
-    mutex_unlock(&cache_lock);
 }
 
-/* FIXME: Is it necessary to keep this copy/pasted code? */
+/* As do_item_unlink(), for callers that already hold the LRU lock of the
+ * item's class. */
 void do_item_unlink_nolock(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UNLINK(ITEM_key(it), it->nkey, it->nbytes);
     if ((it->it_flags & ITEM_LINKED) != 0) {
         it->it_flags &= ~ITEM_LINKED;
         STATS_LOCK();
-        stats.curr_bytes -= ITEM_ntotal(it);
+        stats.curr_bytes -= item_total_bytes(it);
         stats.curr_items -= 1;
         STATS_UNLOCK();
         assoc_delete(ITEM_key(it), it->nkey, hv);
-        item_unlink_q(it);
+        do_item_unlink_q(it);
         do_item_remove(it);
     }
 }
 
+/* Appends (or with prepend, prepends) the value of it to old_it's in the
+ * unused tail of old_it's own chunk, and gives old_it a new CAS. That is
+ * only done if it fits and nobody else holds a reference to old_it: hot
+ * caches and GETs in progress do, and with epoch_reclaim GETs read without
+ * one, so it's never done then. Returns false if the caller has to copy
+ * both values into a new item instead. The caller holds the item lock for
+ * hv and a reference to old_it. */
+bool do_item_append(item *old_it, item *it, const bool prepend,
+                    const uint32_t hv) {
+    size_t old_total = ITEM_ntotal(old_it);
+    int add = it->nbytes - 2;   /* the CRLF is there already */
+
+    if (settings.epoch_reclaim ||
+        (old_it->it_flags & (ITEM_CHUNKED|ITEM_COUNTER|ITEM_LINKED))
+            != ITEM_LINKED ||
+        (it->it_flags & ITEM_CHUNKED) ||
+        old_total + add > slabs_chunk_size(old_it->slabs_clsid))
+        return false;
+
+    /* Optimistic readers take their reference without the item lock, then
+     * check the chain's sequence; once it's odd they back off. */
+    item_lock_seq_bump(hv);
+    if (old_it->refcount != 2) {
+        item_lock_seq_bump(hv);
+        return false;
+    }
+
+    if (prepend) {
+        memmove(ITEM_data(old_it) + add, ITEM_data(old_it), old_it->nbytes);
+        memcpy(ITEM_data(old_it), ITEM_data(it), add);
+    } else {
+        memcpy(ITEM_data(old_it) + old_it->nbytes - 2, ITEM_data(it),
+               it->nbytes);
+    }
+    old_it->nbytes += add;
+    ITEM_set_cas(old_it, (settings.use_cas) ?
+                 get_cas_id(ITEM_get_cas(old_it)) : 0);
+    item_lock_seq_bump(hv);
+
+    slabs_adjust_mem_requested(old_it->slabs_clsid, old_total,
+                               ITEM_ntotal(old_it));
+    STATS_LOCK();
+    stats.curr_bytes += add;
+    STATS_UNLOCK();
+    do_item_update(old_it);
+    return true;
+}
+
 void do_item_remove(item *it) {
     MEMCACHED_ITEM_REMOVE(ITEM_key(it), it->nkey, it->nbytes);
     assert((it->it_flags & ITEM_SLABBED) == 0);
@@ -353,30 +1350,48 @@ void do_item_remove(item *it) {
 
 void do_item_update(item *it) {
     MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
+    if (HITS_MARK_ONLY) {
+        /* Just mark it; the maintainer thread or the clock hand looks at
+         * it later, so hits never wait on the LRU lock. Optimistic readers may be setting
+         * ITEM_FETCHED at the same time, hence the atomic update. */
+        if ((it->it_flags & ITEM_ACTIVE) == 0)
+            item_flags_set(it, ITEM_ACTIVE);
+        if (it->time < current_time - ITEM_UPDATE_INTERVAL)
+            it->time = current_time;
+        return;
+    }
     if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
         assert((it->it_flags & ITEM_SLABBED) == 0);
 
-        mutex_lock(&cache_lock);
+        mutex_lock(&lru_locks[it->slabs_clsid]);
         if ((it->it_flags & ITEM_LINKED) != 0) {
-            item_unlink_q(it);
+            do_item_unlink_q(it);
             it->time = current_time;
-            item_link_q(it);
+            do_item_link_q(it, COLD_LRU);
         }
-        mutex_unlock(&cache_lock);
+        mutex_unlock(&lru_locks[it->slabs_clsid]);
     }
 }
 
+/* True if do_item_update() has anything to do for it. Checked without the
+ * item lock, so most hits on a busy item don't queue on it. */
+bool item_update_due(item *it) {
+    if (it->time < current_time - ITEM_UPDATE_INTERVAL)
+        return true;
+    return HITS_MARK_ONLY && (it->it_flags & ITEM_ACTIVE) == 0;
+}
+
 int do_item_replace(item *it, item *new_it, const uint32_t hv) {
     MEMCACHED_ITEM_REPLACE(ITEM_key(it), it->nkey, it->nbytes,
                            ITEM_key(new_it), new_it->nkey, new_it->nbytes);
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
     do_item_unlink(it, hv);
-    return do_item_link(new_it, hv);
+    return do_item_link_cas(new_it, hv, ITEM_get_cas(it));
 }
 
 /*@null@*/
-char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes) {
+char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes) {
     unsigned int memlimit = 2 * 1024 * 1024;   /* 2MB max response size */
     char *buffer;
     unsigned int bufcurr;
@@ -385,28 +1400,38 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
     unsigned int shown = 0;
     char key_temp[KEY_MAX_LENGTH + 1];
     char temp[512];
-
-    it = heads[slabs_clsid];
+    int lru = HOT_LRU;
 
     buffer = malloc((size_t)memlimit);
     if (buffer == 0) return NULL;
     bufcurr = 0;
 
-    while (it != NULL && (limit == 0 || shown < limit)) {
+    mutex_lock(&lru_locks[slabs_clsid]);
+    it = heads[slabs_clsid][lru];
+
+    while (limit == 0 || shown < limit) {
+        /* Most recently used first: HOT, then WARM, then COLD. */
+        if (it == NULL) {
+            if (++lru == LRU_SEGMENTS)
+                break;
+            it = heads[slabs_clsid][lru];
+            continue;
+        }
         assert(it->nkey <= KEY_MAX_LENGTH);
         /* Copy the key since it may not be null-terminated in the struct */
         strncpy(key_temp, ITEM_key(it), it->nkey);
         key_temp[it->nkey] = 0x00; /* terminate */
         len = snprintf(temp, sizeof(temp), "ITEM %s [%d b; %lu s]\r\n",
-                       key_temp, it->nbytes - 2,
+                       key_temp, item_value_length(it),
                        (unsigned long)it->exptime + process_started);
         if (bufcurr + len + 6 > memlimit)  /* 6 is END\r\n\0 */
             break;
         memcpy(buffer + bufcurr, temp, len);
         bufcurr += len;
         shown++;
-        it = it->next;
+        it = ITEM_next(it);
     }
+    mutex_unlock(&lru_locks[slabs_clsid]);
 
     memcpy(buffer + bufcurr, "END\r\n", 6);
     bufcurr += 5;
@@ -415,24 +1440,174 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
     return buffer;
 }
 
+typedef struct {
+    char *buf;
+    unsigned int len;
+    unsigned int size;
+    unsigned int shown;
+    bool failed;
+} keys_dump_t;
+
+/* Longest line keys_dump_item() writes, beyond the key itself. */
+#define KEYS_LINE_MAX 64
+
+/* assoc_scan() callback for item_keys(); runs under the item's lock. */
+static void keys_dump_item(item *it, void *arg) {
+    keys_dump_t *d = arg;
+    long ttl = -1;
+
+    if (d->failed || item_is_flushed(it) ||
+        (it->exptime != 0 && it->exptime <= current_time))
+        return;
+    if (d->len + it->nkey + KEYS_LINE_MAX > d->size) {
+        char *buf = realloc(d->buf, d->size * 2);
+        if (buf == NULL) {
+            d->failed = true;
+            return;
+        }
+        d->buf = buf;
+        d->size *= 2;
+    }
+    if (it->exptime != 0)
+        ttl = it->exptime - current_time;
+    d->len += snprintf(d->buf + d->len, d->size - d->len,
+                       "KEY %.*s %ld %d %u\r\n", it->nkey, ITEM_key(it), ttl,
+                       item_value_length(it), current_time - it->time);
+    d->shown++;
+}
+
+/*
+ * Lists the keys under *cursor and the buckets after it, until count keys
+ * were found or ten times as many buckets were looked at, whichever comes
+ * first. *cursor is moved on to where the next call should continue, 0 once
+ * the walk is over. Unlike item_cachedump(), no lock is held between
+ * buckets, and all slab classes are covered.
+ */
+char *item_keys(uint32_t *cursor, const unsigned int count, unsigned int *bytes) {
+    keys_dump_t d;
+    unsigned int buckets = 0;
+
+    memset(&d, 0, sizeof(d));
+    d.size = 4096;
+    if ((d.buf = malloc(d.size)) == NULL)
+        return NULL;
+
+    do {
+        *cursor = assoc_scan(*cursor, keys_dump_item, &d);
+    } while (*cursor != 0 && d.shown < count && ++buckets < count * 10);
+
+    if (d.failed) {
+        free(d.buf);
+        return NULL;
+    }
+    d.len += snprintf(d.buf + d.len, d.size - d.len, "END %u\r\n", *cursor);
+    *bytes = d.len;
+    return d.buf;
+}
+
+/*
+ * The prefix sweep thread walks the hash table after a flush_prefix and
+ * unlinks the items it killed, a batch of buckets at a time, then drops the
+ * flushes it covered so gets stop checking them. Flushes made while it walks
+ * wait for the next walk.
+ */
+#define PREFIX_SWEEP_BATCH 1024
+#define PREFIX_SWEEP_SLEEP 1000
+
+static volatile int do_run_prefix_sweep_thread = 0;
+static pthread_t prefix_sweep_tid;
+static pthread_mutex_t prefix_sweep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefix_sweep_cond = PTHREAD_COND_INITIALIZER;
+static bool prefix_sweep_wanted = false;
+
+static void prefix_sweep_wake(void) {
+    mutex_lock(&prefix_sweep_lock);
+    if (!prefix_sweep_wanted) {
+        prefix_sweep_wanted = true;
+        pthread_cond_signal(&prefix_sweep_cond);
+    }
+    mutex_unlock(&prefix_sweep_lock);
+}
+
+/* assoc_scan() callback; runs under the item's lock. */
+static void prefix_sweep_item(item *it, void *arg) {
+    if (item_prefix_flushed(it))
+        do_item_unlink(it, ITEM_hv(it));
+}
+
+static void *prefix_sweep_thread(void *arg) {
+    while (do_run_prefix_sweep_thread) {
+        uint64_t covered;
+        uint32_t cursor = 0;
+        unsigned int buckets = 0;
+
+        mutex_lock(&prefix_sweep_lock);
+        while (!prefix_sweep_wanted && do_run_prefix_sweep_thread)
+            pthread_cond_wait(&prefix_sweep_cond, &prefix_sweep_lock);
+        prefix_sweep_wanted = false;
+        mutex_unlock(&prefix_sweep_lock);
+
+        mutex_lock(&prefix_flush_lock);
+        covered = prefix_flush_cas;
+        mutex_unlock(&prefix_flush_lock);
+
+        do {
+            cursor = assoc_scan(cursor, prefix_sweep_item, NULL);
+            if (++buckets % PREFIX_SWEEP_BATCH == 0)
+                usleep(PREFIX_SWEEP_SLEEP);
+        } while (cursor != 0 && do_run_prefix_sweep_thread);
+
+        if (cursor == 0)
+            prefix_flush_expire(covered);
+    }
+    return NULL;
+}
+
+int start_prefix_sweep_thread(void) {
+    int ret;
+
+    do_run_prefix_sweep_thread = 1;
+    if ((ret = pthread_create(&prefix_sweep_tid, NULL,
+                              prefix_sweep_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create prefix sweep thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+void stop_prefix_sweep_thread(void) {
+    mutex_lock(&prefix_sweep_lock);
+    do_run_prefix_sweep_thread = 0;
+    pthread_cond_signal(&prefix_sweep_cond);
+    mutex_unlock(&prefix_sweep_lock);
+    pthread_join(prefix_sweep_tid, NULL);
+}
+
 void item_stats_evictions(uint64_t *evicted) {
     int i;
-    mutex_lock(&cache_lock);
     for (i = 0; i < LARGEST_ID; i++) {
+        mutex_lock(&lru_locks[i]);
         evicted[i] = itemstats[i].evicted;
+        mutex_unlock(&lru_locks[i]);
     }
-    mutex_unlock(&cache_lock);
 }
 
-void do_item_stats_totals(ADD_STAT add_stats, void *c) {
+void item_stats_totals(ADD_STAT add_stats, void *c) {
     itemstats_t totals;
     memset(&totals, 0, sizeof(itemstats_t));
     int i;
     for (i = 0; i < LARGEST_ID; i++) {
+        mutex_lock(&lru_locks[i]);
         totals.expired_unfetched += itemstats[i].expired_unfetched;
         totals.evicted_unfetched += itemstats[i].evicted_unfetched;
         totals.evicted += itemstats[i].evicted;
         totals.reclaimed += itemstats[i].reclaimed;
+        totals.admitted += itemstats[i].admitted;
+        totals.rejected += itemstats[i].rejected;
+        totals.reserve_hits += itemstats[i].reserve_hits;
+        totals.reserve_misses += itemstats[i].reserve_misses;
+        mutex_unlock(&lru_locks[i]);
     }
     APPEND_STAT("expired_unfetched", "%llu",
                 (unsigned long long)totals.expired_unfetched);
@@ -442,38 +1617,117 @@ void do_item_stats_totals(ADD_STAT add_stats, void *c) {
                 (unsigned long long)totals.evicted);
     APPEND_STAT("reclaimed", "%llu",
                 (unsigned long long)totals.reclaimed);
+    if (settings.evict_reserve > 0) {
+        APPEND_STAT("reserve_hits", "%llu",
+                    (unsigned long long)totals.reserve_hits);
+        APPEND_STAT("reserve_misses", "%llu",
+                    (unsigned long long)totals.reserve_misses);
+        APPEND_STAT("evictor_cpu_usec", "%llu",
+                    (unsigned long long)evictor_cpu_time());
+    }
+    if (settings.lru_mode == LRU_MODE_TINYLFU) {
+        APPEND_STAT("evictions_admitted", "%llu",
+                    (unsigned long long)totals.admitted);
+        APPEND_STAT("evictions_rejected", "%llu",
+                    (unsigned long long)totals.rejected);
+    }
+}
+
+/* The least recently used item of class id, or NULL if it has none. The
+ * caller holds the class's LRU lock. */
+static item *lru_oldest(const int id) {
+    int lru;
+    for (lru = COLD_LRU; lru >= HOT_LRU; lru--) {
+        if (tails[id][lru] != NULL)
+            return tails[id][lru];
+    }
+    return NULL;
 }
 
-void do_item_stats(ADD_STAT add_stats, void *c) {
+void item_stats(ADD_STAT add_stats, void *c) {
     int i;
     for (i = 0; i < LARGEST_ID; i++) {
-        if (tails[i] != NULL) {
+        itemstats_t st;
+        unsigned int size[LRU_SEGMENTS];
+        rel_time_t age = 0;
+        item *oldest;
+
+        /* Copy the class out so the LRU lock isn't held while writing. */
+        mutex_lock(&lru_locks[i]);
+        oldest = lru_oldest(i);
+        if (oldest != NULL)
+            age = current_time - oldest->time;
+        st = itemstats[i];
+        memcpy(size, sizes[i], sizeof(size));
+        mutex_unlock(&lru_locks[i]);
+
+        if (oldest != NULL) {
             const char *fmt = "items:%d:%s";
             char key_str[STAT_KEY_LEN];
             char val_str[STAT_VAL_LEN];
             int klen = 0, vlen = 0;
-            if (tails[i] == NULL) {
-                /* We removed all of the items in this slab class */
-                continue;
+            APPEND_NUM_FMT_STAT(fmt, i, "number", "%u",
+                                size[HOT_LRU] + size[WARM_LRU] + size[COLD_LRU]);
+            if (settings.lru_segmented) {
+                APPEND_NUM_FMT_STAT(fmt, i, "number_hot", "%u", size[HOT_LRU]);
+                APPEND_NUM_FMT_STAT(fmt, i, "number_warm", "%u", size[WARM_LRU]);
+                APPEND_NUM_FMT_STAT(fmt, i, "number_cold", "%u", size[COLD_LRU]);
             }
-            APPEND_NUM_FMT_STAT(fmt, i, "number", "%u", sizes[i]);
-            APPEND_NUM_FMT_STAT(fmt, i, "age", "%u", current_time - tails[i]->time);
+            APPEND_NUM_FMT_STAT(fmt, i, "age", "%u", age);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted",
-                                "%llu", (unsigned long long)itemstats[i].evicted);
+                                "%llu", (unsigned long long)st.evicted);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_nonzero",
-                                "%llu", (unsigned long long)itemstats[i].evicted_nonzero);
+                                "%llu", (unsigned long long)st.evicted_nonzero);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_time",
-                                "%u", itemstats[i].evicted_time);
+                                "%u", st.evicted_time);
             APPEND_NUM_FMT_STAT(fmt, i, "outofmemory",
-                                "%llu", (unsigned long long)itemstats[i].outofmemory);
+                                "%llu", (unsigned long long)st.outofmemory);
             APPEND_NUM_FMT_STAT(fmt, i, "tailrepairs",
-                                "%llu", (unsigned long long)itemstats[i].tailrepairs);
+                                "%llu", (unsigned long long)st.tailrepairs);
             APPEND_NUM_FMT_STAT(fmt, i, "reclaimed",
-                                "%llu", (unsigned long long)itemstats[i].reclaimed);
+                                "%llu", (unsigned long long)st.reclaimed);
             APPEND_NUM_FMT_STAT(fmt, i, "expired_unfetched",
-                                "%llu", (unsigned long long)itemstats[i].expired_unfetched);
+                                "%llu", (unsigned long long)st.expired_unfetched);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_unfetched",
-                                "%llu", (unsigned long long)itemstats[i].evicted_unfetched);
+                                "%llu", (unsigned long long)st.evicted_unfetched);
+            if (settings.lru_segmented) {
+                APPEND_NUM_FMT_STAT(fmt, i, "moves_to_cold",
+                                    "%llu", (unsigned long long)st.moves_to_cold);
+                APPEND_NUM_FMT_STAT(fmt, i, "moves_to_warm",
+                                    "%llu", (unsigned long long)st.moves_to_warm);
+            }
+            if (settings.lru_mode == LRU_MODE_CLOCK) {
+                APPEND_NUM_FMT_STAT(fmt, i, "clock_cleared",
+                                    "%llu", (unsigned long long)st.clock_cleared);
+            }
+            if (settings.lru_mode == LRU_MODE_LFU) {
+                APPEND_NUM_FMT_STAT(fmt, i, "lfu_spared",
+                                    "%llu", (unsigned long long)st.lfu_spared);
+            }
+            if (settings.lru_mode == LRU_MODE_TINYLFU) {
+                APPEND_NUM_FMT_STAT(fmt, i, "admitted",
+                                    "%llu", (unsigned long long)st.admitted);
+                APPEND_NUM_FMT_STAT(fmt, i, "rejected",
+                                    "%llu", (unsigned long long)st.rejected);
+            }
+            if (settings.lru_crawler) {
+                APPEND_NUM_FMT_STAT(fmt, i, "crawler_reclaimed",
+                                    "%llu", (unsigned long long)st.crawler_reclaimed);
+                APPEND_NUM_FMT_STAT(fmt, i, "crawler_duration",
+                                    "%llu", (unsigned long long)st.crawler_duration);
+            }
+            if (settings.expiry_wheel) {
+                APPEND_NUM_FMT_STAT(fmt, i, "expired_freed",
+                                    "%llu", (unsigned long long)st.expired_freed);
+                APPEND_NUM_FMT_STAT(fmt, i, "wheel_entries",
+                                    "%u", wheel_count(i));
+            }
+            if (settings.evict_reserve > 0) {
+                APPEND_NUM_FMT_STAT(fmt, i, "reserve_hits",
+                                    "%llu", (unsigned long long)st.reserve_hits);
+                APPEND_NUM_FMT_STAT(fmt, i, "reserve_misses",
+                                    "%llu", (unsigned long long)st.reserve_misses);
+            }
         }
     }
 
@@ -483,7 +1737,7 @@ void do_item_stats(ADD_STAT add_stats, void *c) {
 
 /** dumps out a list of objects of each size, with granularity of 32 bytes */
 /*@null@*/
-void do_item_stats_sizes(ADD_STAT add_stats, void *c) {
+void item_stats_sizes(ADD_STAT add_stats, void *c) {
 
     /* max 1MB object, divided into 32 bytes size buckets */
     const int num_buckets = 32768;
@@ -494,14 +1748,19 @@ void do_item_stats_sizes(ADD_STAT add_stats, void *c) {
 
         /* build the histogram */
         for (i = 0; i < LARGEST_ID; i++) {
-            item *iter = heads[i];
-            while (iter) {
-                int ntotal = ITEM_ntotal(iter);
-                int bucket = ntotal / 32;
-                if ((ntotal % 32) != 0) bucket++;
-                if (bucket < num_buckets) histogram[bucket]++;
-                iter = iter->next;
+            int lru;
+            mutex_lock(&lru_locks[i]);
+            for (lru = HOT_LRU; lru < LRU_SEGMENTS; lru++) {
+                item *iter = heads[i][lru];
+                while (iter) {
+                    int ntotal = ITEM_ntotal(iter);
+                    int bucket = ntotal / 32;
+                    if ((ntotal % 32) != 0) bucket++;
+                    if (bucket < num_buckets) histogram[bucket]++;
+                    iter = ITEM_next(iter);
+                }
             }
+            mutex_unlock(&lru_locks[i]);
         }
 
         /* write the buffer */
@@ -518,18 +1777,22 @@ void do_item_stats_sizes(ADD_STAT add_stats, void *c) {
 }
 
 /** wrapper around assoc_find which does the lazy expiration logic */
-item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
+/* do_item_get(), taking a reference on the item only if ref is set. */
+static item *do_item_find(const char *key, const size_t nkey,
+                          const uint32_t hv, const bool ref) {
     //mutex_lock(&cache_lock);
     item *it = assoc_find(key, nkey, hv);
     if (it != NULL) {
-        refcount_incr(&it->refcount);
+        if (ref)
+            refcount_incr(&it->refcount);
         /* Optimization for slab reassignment. prevents popular items from
          * jamming in busy wait. Can only do this here to satisfy lock order
-         * of item_lock, cache_lock, slabs_lock. */
+         * of item_lock, LRU lock, slabs_lock. */
         if (slab_rebalance_signal &&
             ((void *)it >= slab_rebal.slab_start && (void *)it < slab_rebal.slab_end)) {
-            do_item_unlink_nolock(it, hv);
-            do_item_remove(it);
+            do_item_unlink(it, hv);
+            if (ref)
+                do_item_remove(it);
             it = NULL;
         }
     }
@@ -546,17 +1809,18 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
     }
 
     if (it != NULL) {
-        if (settings.oldest_live != 0 && settings.oldest_live <= current_time &&
-            it->time <= settings.oldest_live) {
+        if (item_is_flushed(it)) {
             do_item_unlink(it, hv);
-            do_item_remove(it);
+            if (ref)
+                do_item_remove(it);
             it = NULL;
             if (was_found) {
                 fprintf(stderr, " -nuked by flush");
             }
         } else if (it->exptime != 0 && it->exptime <= current_time) {
             do_item_unlink(it, hv);
-            do_item_remove(it);
+            if (ref)
+                do_item_remove(it);
             it = NULL;
             if (was_found) {
                 fprintf(stderr, " -nuked by expire");
@@ -573,37 +1837,762 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
     return it;
 }
 
+item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
+    return do_item_find(key, nkey, hv, true);
+}
+
+/* do_item_get() for a worker inside an epoch (see epoch_enter()): the item
+ * is returned without a reference and stays valid until the worker leaves
+ * the epoch. */
+item *do_item_get_unref(const char *key, const size_t nkey, const uint32_t hv) {
+    return do_item_find(key, nkey, hv, false);
+}
+
+/* Lock-free variant of do_item_get(), used by item_get() when
+ * settings.optimistic_get is on. The caller does *not* hold the item lock.
+ * Returns false if the lookup could not be validated or the item needs work
+ * that requires the lock (lazy expiry, flush, slab rebalance); the caller
+ * must then retry with do_item_get(). On true, *itp is the referenced item
+ * or NULL for a clean miss. Without ref, the caller is inside an epoch and
+ * *itp is returned without a reference, as by do_item_get_unref(). */
+bool item_get_optimistic(const char *key, const size_t nkey, const uint32_t hv,
+                         item **itp, const bool ref) {
+    unsigned int seq = item_lock_seq(hv);
+    item *it;
+
+    *itp = NULL;
+    if (seq & 1)
+        return false;   /* a writer is busy on this chain */
+    if (!assoc_find_optimistic(key, nkey, hv, seq, &it))
+        return false;
+    if (it == NULL) {
+        if (settings.verbose > 2)
+            fprintf(stderr, "> NOT FOUND %s\n", key);
+        return true;
+    }
+
+    /* Never resurrect an item whose last reference is gone. The epoch
+     * keeps its memory from being reused instead. */
+    if (ref && !refcount_incr_nonzero(&it->refcount))
+        return false;
+
+    /* The chain didn't change between the walk and our incr, so the item is
+     * still linked and the reference is good. */
+    if (item_lock_seq(hv) != seq || item_is_flushed(it) ||
+        (it->exptime != 0 && it->exptime <= current_time) ||
+        (slab_rebalance_signal &&
+         ((void *)it >= slab_rebal.slab_start && (void *)it < slab_rebal.slab_end))) {
+        if (ref)
+            do_item_remove(it);
+        return false;
+    }
+
+    /* Writers modify it_flags under the item lock without atomics; a plain
+     * |= here could resurrect a flag they just cleared. */
+    if ((it->it_flags & ITEM_FETCHED) == 0)
+        item_flags_set(it, ITEM_FETCHED);
+    DEBUG_REFCNT(it, '+');
+    if (settings.verbose > 2)
+        fprintf(stderr, "> FOUND KEY %s\n", ITEM_key(it));
+
+    *itp = it;
+    return true;
+}
+
+/* True if a get would still find it, which the caller holds a reference
+ * to. Checked without the item lock, for the per-thread hot item caches. */
+bool item_is_live(item *it) {
+    return (it->it_flags & ITEM_LINKED) != 0 && !item_is_flushed(it) &&
+        (it->exptime == 0 || it->exptime > current_time);
+}
+
 item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
                     const uint32_t hv) {
     item *it = do_item_get(key, nkey, hv);
     if (it != NULL) {
         it->exptime = exptime;
+        wheel_add(it, hv);
     }
     return it;
 }
 
-/* expires items that are more recent than the oldest_live setting. */
-void do_item_flush_expired(void) {
-    int i;
+/* Unlinks every item of an older flush generation. This stops the world,
+ * so it only runs every FLUSH_GEN_WALK flushes. The caller holds
+ * flush_lock. */
+static void item_flush_walk(void) {
+    int i, lru;
     item *iter, *next;
-    if (settings.oldest_live == 0)
-        return;
+
+    item_lock_all();
     for (i = 0; i < LARGEST_ID; i++) {
-        /* The LRU is sorted in decreasing time order, and an item's timestamp
-         * is never newer than its last access time, so we only need to walk
-         * back until we hit an item older than the oldest_live time.
-         * The oldest_live checking will auto-expire the remaining items.
-         */
-        for (iter = heads[i]; iter != NULL; iter = next) {
-            if (iter->time >= settings.oldest_live) {
-                next = iter->next;
-                if ((iter->it_flags & ITEM_SLABBED) == 0) {
-                    do_item_unlink_nolock(iter, hash(ITEM_key(iter), iter->nkey, 0));
-                }
+        mutex_lock(&lru_locks[i]);
+        for (lru = HOT_LRU; lru < LRU_SEGMENTS; lru++) {
+            for (iter = heads[i][lru]; iter != NULL; iter = next) {
+                next = ITEM_next(iter);
+                if (ITEM_flushed(iter))
+                    do_item_unlink_nolock(iter, ITEM_hv(iter));
+            }
+        }
+        mutex_unlock(&lru_locks[i]);
+    }
+    item_unlock_all();
+}
+
+/* Starts a new flush generation. The caller holds flush_lock. */
+static void flush_gen_bump(void) {
+    /* Items only keep the low bits of the generation. Clear out every
+     * older one before the counter gets round to reusing any of them. */
+    if (((flush_gen + 1) % FLUSH_GEN_WALK) == 0)
+        item_flush_walk();
+    flush_gen++;
+}
+
+/* Flushes every item linked before when, or before now if when is 0 or has
+ * passed. A delayed flush that hasn't happened yet is replaced. */
+void item_flush(const rel_time_t when) {
+    mutex_lock(&flush_lock);
+    if (when > current_time) {
+        flush_pending = when;
+    } else {
+        flush_pending = 0;
+        flush_gen_bump();
+    }
+    mutex_unlock(&flush_lock);
+}
+
+/* Called on every clock tick to carry out a delayed flush once it's due. */
+void item_flush_tick(void) {
+    if (flush_pending == 0)
+        return;
+    mutex_lock(&flush_lock);
+    if (flush_pending != 0 && flush_pending <= current_time) {
+        flush_pending = 0;
+        flush_gen_bump();
+    }
+    mutex_unlock(&flush_lock);
+}
+
+/*
+ * LRU maintainer thread (-o lru_segmented). Keeps each class's HOT and WARM
+ * LRUs within hot_lru_pct and warm_lru_pct of its items, and bumps items
+ * that were fetched while COLD back up to WARM before they are evicted.
+ * Sleeps longer while there is nothing to do.
+ */
+#define MIN_LRU_MAINTAINER_SLEEP 1000
+#define MAX_LRU_MAINTAINER_SLEEP 1000000
+#define LRU_MAINTAINER_BATCH 500
+
+static volatile int do_run_lru_maintainer_thread = 0;
+static pthread_t lru_maintainer_tid;
+
+/* Pulls up to LRU_MAINTAINER_BATCH items off lru of class id if it holds
+ * more than pct percent of the class. */
+static int lru_trim(const unsigned int id, const int lru, const int pct) {
+    unsigned int total = sizes[id][HOT_LRU] + sizes[id][WARM_LRU] +
+        sizes[id][COLD_LRU];
+    unsigned int limit = (uint64_t)total * pct / 100;
+    unsigned int excess;
+
+    if (sizes[id][lru] <= limit)
+        return 0;
+    excess = sizes[id][lru] - limit;
+    if (excess > LRU_MAINTAINER_BATCH)
+        excess = LRU_MAINTAINER_BATCH;
+    return lru_pull_tail(id, lru, excess, false, 0);
+}
+
+/* Returns the number of items moved or unlinked. */
+static int lru_maintain_class(const unsigned int id) {
+    int done = 0;
+
+    mutex_lock(&lru_locks[id]);
+    done += lru_trim(id, HOT_LRU, settings.hot_lru_pct);
+    done += lru_trim(id, WARM_LRU, settings.warm_lru_pct);
+    done += lru_pull_tail(id, COLD_LRU, LRU_MAINTAINER_BATCH, false, 0);
+    mutex_unlock(&lru_locks[id]);
+    return done;
+}
+
+static void *lru_maintainer_thread(void *arg) {
+    useconds_t to_sleep = MIN_LRU_MAINTAINER_SLEEP;
+    unsigned int id;
+
+    while (do_run_lru_maintainer_thread) {
+        int done = 0;
+
+        usleep(to_sleep);
+        for (id = POWER_SMALLEST; id < LARGEST_ID; id++) {
+            done += lru_maintain_class(id);
+        }
+
+        if (done == 0) {
+            if (to_sleep < MAX_LRU_MAINTAINER_SLEEP)
+                to_sleep *= 2;
+        } else {
+            to_sleep = MIN_LRU_MAINTAINER_SLEEP;
+        }
+    }
+    return NULL;
+}
+
+int start_lru_maintainer_thread(void) {
+    int ret;
+
+    do_run_lru_maintainer_thread = 1;
+    if ((ret = pthread_create(&lru_maintainer_tid, NULL,
+                              lru_maintainer_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create LRU maintainer thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+void stop_lru_maintainer_thread(void) {
+    do_run_lru_maintainer_thread = 0;
+    pthread_join(lru_maintainer_tid, NULL);
+}
+
+/*
+ * LRU crawler thread (-o lru_crawler). Walks every LRU of every class from
+ * tail to head, unlinking items that have expired or were flushed, so their
+ * memory is reused before anything live has to be evicted. The class's LRU
+ * lock is held for at most LRU_CRAWLER_BATCH items at a time, with
+ * lru_crawler_sleep microseconds between batches.
+ */
+#define LRU_CRAWLER_BATCH 100
+#define LRU_CRAWLER_PAUSE 1000000
+
+static volatile int do_run_lru_crawler_thread = 0;
+static pthread_t lru_crawler_tid;
+
+/* Checks up to LRU_CRAWLER_BATCH items from crawler_pos[id] on. Returns
+ * true if there are more to go. The caller holds the LRU lock of id. */
+static bool lru_crawl_batch(const unsigned int id) {
+    item *search;
+    int n;
+
+    for (n = 0; n < LRU_CRAWLER_BATCH && (search = crawler_pos[id]) != NULL;
+         n++) {
+        uint32_t hv = ITEM_hv(search);
+        void *hold_lock;
+
+        crawler_pos[id] = ITEM_prev(search);
+        if ((hold_lock = item_trylock(hv)) == NULL)
+            continue;
+        if ((search->exptime != 0 && search->exptime < current_time)
+            || item_is_flushed(search)) {
+            /* Only ours and the link's reference: nobody is using it. */
+            if (refcount_incr(&search->refcount) == 2) {
+                itemstats[id].crawler_reclaimed++;
+                if ((search->it_flags & ITEM_FETCHED) == 0)
+                    itemstats[id].expired_unfetched++;
+                do_item_unlink_nolock(search, hv);
+                do_item_remove(search);
             } else {
-                /* We've hit the first old item. Continue to the next queue. */
-                break;
+                refcount_decr(&search->refcount);
             }
         }
+        item_trylock_unlock(hold_lock);
+    }
+    return crawler_pos[id] != NULL;
+}
+
+static void lru_crawl_class(const unsigned int id) {
+    struct timeval start, end;
+    int lru;
+
+    gettimeofday(&start, NULL);
+    for (lru = HOT_LRU; lru < LRU_SEGMENTS; lru++) {
+        mutex_lock(&lru_locks[id]);
+        crawler_pos[id] = tails[id][lru];
+        while (lru_crawl_batch(id) && do_run_lru_crawler_thread) {
+            mutex_unlock(&lru_locks[id]);
+            if (settings.lru_crawler_sleep)
+                usleep(settings.lru_crawler_sleep);
+            mutex_lock(&lru_locks[id]);
+        }
+        crawler_pos[id] = NULL;
+        mutex_unlock(&lru_locks[id]);
+    }
+    gettimeofday(&end, NULL);
+
+    mutex_lock(&lru_locks[id]);
+    itemstats[id].crawler_duration = (end.tv_sec - start.tv_sec) * 1000000ULL
+        + end.tv_usec - start.tv_usec;
+    mutex_unlock(&lru_locks[id]);
+}
+
+static void *lru_crawler_thread(void *arg) {
+    unsigned int id;
+
+    while (do_run_lru_crawler_thread) {
+        for (id = POWER_SMALLEST;
+             id < LARGEST_ID && do_run_lru_crawler_thread; id++) {
+            lru_crawl_class(id);
+        }
+        usleep(LRU_CRAWLER_PAUSE);
+    }
+    return NULL;
+}
+
+int start_lru_crawler_thread(void) {
+    int ret;
+
+    do_run_lru_crawler_thread = 1;
+    if ((ret = pthread_create(&lru_crawler_tid, NULL,
+                              lru_crawler_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create LRU crawler thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+void stop_lru_crawler_thread(void) {
+    do_run_lru_crawler_thread = 0;
+    pthread_join(lru_crawler_tid, NULL);
+}
+
+/*
+ * Background evictor (-o evict_reserve). Once memory is full, keeps
+ * evict_reserve free chunks in each class that has pages, evicting up to
+ * EVICTOR_BATCH items from its tail at a time, so sets normally take a chunk
+ * off the freelist rather than evicting one themselves. An allocation that
+ * finds the freelist empty wakes it up; otherwise it sleeps longer while
+ * there is nothing to do.
+ */
+#define EVICTOR_BATCH 64
+#define MIN_EVICTOR_SLEEP 100
+#define MAX_EVICTOR_SLEEP 100000
+
+static volatile int do_run_evictor_thread = 0;
+static pthread_t evictor_tid;
+static pthread_mutex_t evictor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t evictor_cond = PTHREAD_COND_INITIALIZER;
+static bool evictor_wanted = false;
+/* CPU time the evictor has used, under evictor_lock */
+static uint64_t evictor_cpu_usec = 0;
+
+static void evictor_wake(void) {
+    mutex_lock(&evictor_lock);
+    if (!evictor_wanted) {
+        evictor_wanted = true;
+        pthread_cond_signal(&evictor_cond);
+    }
+    mutex_unlock(&evictor_lock);
+}
+
+/* Evicts from class id until it has evict_reserve free chunks, or
+ * EVICTOR_BATCH items have gone. Returns the number evicted. */
+static int evictor_fill_class(const unsigned int id) {
+    unsigned int avail = slabs_free_chunks(id);
+    unsigned int want;
+    int done;
+    item *it;
+
+    if (avail >= (unsigned int)settings.evict_reserve)
+        return 0;
+    want = settings.evict_reserve - avail;
+    if (want > EVICTOR_BATCH)
+        want = EVICTOR_BATCH;
+    for (done = 0; done < want; done++) {
+        if ((it = do_item_alloc_pull(sizeof(item) + 1, id, 0, 0, true)) == NULL)
+            break;
+        /* An optimistic reader that looked the evicted item up may still
+         * hold a reference, and then frees it when it lets go. Leave it
+         * looking like an empty item for that. */
+        it->it_flags = 0;
+        it->nkey = 0;
+        it->nbytes = 0;
+        if (refcount_decr(&it->refcount) == 0) {
+            it->slabs_clsid = 0;
+            slabs_free(it, ITEM_ntotal(it), id);
+        }
     }
+    return done;
+}
+
+static uint64_t evictor_cpu_time(void) {
+    uint64_t usec;
+    mutex_lock(&evictor_lock);
+    usec = evictor_cpu_usec;
+    mutex_unlock(&evictor_lock);
+    return usec;
+}
+
+/* CPU time the calling thread has used, in microseconds. */
+static uint64_t thread_cpu_usec(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+static void *evictor_thread(void *arg) {
+    useconds_t to_sleep = MIN_EVICTOR_SLEEP;
+    unsigned int id;
+
+    while (do_run_evictor_thread) {
+        struct timeval now;
+        struct timespec until;
+        int done = 0;
+
+        gettimeofday(&now, NULL);
+        now.tv_usec += to_sleep;
+        until.tv_sec = now.tv_sec + now.tv_usec / 1000000;
+        until.tv_nsec = (now.tv_usec % 1000000) * 1000;
+        mutex_lock(&evictor_lock);
+        if (!evictor_wanted && do_run_evictor_thread)
+            pthread_cond_timedwait(&evictor_cond, &evictor_lock, &until);
+        evictor_wanted = false;
+        mutex_unlock(&evictor_lock);
+
+        for (id = POWER_SMALLEST; id < LARGEST_ID; id++) {
+            done += evictor_fill_class(id);
+        }
+
+        if (done == 0) {
+            if (to_sleep < MAX_EVICTOR_SLEEP)
+                to_sleep *= 2;
+        } else {
+            to_sleep = MIN_EVICTOR_SLEEP;
+        }
+        mutex_lock(&evictor_lock);
+        evictor_cpu_usec = thread_cpu_usec();
+        mutex_unlock(&evictor_lock);
+    }
+    return NULL;
+}
+
+int start_evictor_thread(void) {
+    int ret;
+
+    do_run_evictor_thread = 1;
+    if ((ret = pthread_create(&evictor_tid, NULL,
+                              evictor_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create evictor thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+void stop_evictor_thread(void) {
+    mutex_lock(&evictor_lock);
+    do_run_evictor_thread = 0;
+    pthread_cond_signal(&evictor_cond);
+    mutex_unlock(&evictor_lock);
+    pthread_join(evictor_tid, NULL);
+}
+
+/*
+ * Expiry wheel (-o expiry_wheel). Items with an exptime are indexed by it in
+ * a hierarchical timer wheel: 256 slots of a second, then three levels of 64
+ * slots, each 64 times as wide as the slots below, which reaches about two
+ * years out. Every second the expiry thread frees the items of the slot that
+ * came due, so their memory is reused at once and only expired items are
+ * looked at. As time moves on, the slots of the upper levels are spread over
+ * the level below. Each slab class has its own wheel and lock, so sets in
+ * different classes don't wait on each other.
+ *
+ * Entries live outside the slabs and aren't removed when their item is
+ * unlinked, replaced or touched; they are checked against the hash table
+ * when their slot comes due. So they don't pile up when items with long
+ * expiry times are overwritten, a wheel is swept of stale entries once it
+ * has half again as many as its class has chunks. Past twice as many, new
+ * entries are dropped and their items left to the LRU, which keeps the
+ * wheels to a fraction of the memory limit.
+ */
+#define WHEEL_BITS0 8
+#define WHEEL_BITS 6
+#define WHEEL_LEVELS 3
+#define WHEEL_SLOTS0 (1 << WHEEL_BITS0)
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_SLEEP 100000
+#define WHEEL_CAP_MIN 1024
+
+typedef struct {
+    item *it;
+    uint32_t hv;
+    rel_time_t exptime;
+} wheel_entry_t;
+
+typedef struct {
+    wheel_entry_t *entries;
+    unsigned int count;
+    unsigned int size;
+} wheel_slot_t;
+
+typedef struct {
+    wheel_slot_t slots0[WHEEL_SLOTS0];
+    wheel_slot_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    rel_time_t time;            /* the next second to expire */
+    unsigned int entries;
+    unsigned int cap;           /* most entries it may hold */
+    rel_time_t cap_time;        /* when cap was last worked out */
+    pthread_mutex_t lock;
+} wheel_t;
+
+static wheel_t wheels[LARGEST_ID];
+
+static volatile int do_run_expiry_wheel_thread = 0;
+static pthread_t expiry_wheel_tid;
+
+/* The most entries the wheel of class id may hold: twice its chunks. */
+static unsigned int wheel_cap(const unsigned int id) {
+    unsigned int chunks = slabs_chunks(id);
+
+    return chunks > WHEEL_CAP_MIN / 2 ? chunks * 2 : WHEEL_CAP_MIN;
+}
+
+/* The slot an entry expiring at exptime goes in. The caller holds
+ * w->lock. */
+static wheel_slot_t *wheel_slot(wheel_t *w, const rel_time_t exptime) {
+    int delta = exptime - w->time;
+    int level, shift;
+
+    if (delta < 0)
+        return &w->slots0[w->time & (WHEEL_SLOTS0 - 1)];
+    if (delta < WHEEL_SLOTS0)
+        return &w->slots0[exptime & (WHEEL_SLOTS0 - 1)];
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        shift = WHEEL_BITS0 + (level + 1) * WHEEL_BITS;
+        if (delta < (1 << shift))
+            break;
+    }
+    shift = WHEEL_BITS0 + level * WHEEL_BITS;
+    return &w->slots[level][(exptime >> shift) & (WHEEL_SLOTS - 1)];
+}
+
+/* Adds e to w. The caller holds w->lock. If there's no memory the entry is
+ * dropped, and its item is left to the LRU as usual. */
+static void wheel_insert(wheel_t *w, const wheel_entry_t *e) {
+    wheel_slot_t *slot = wheel_slot(w, e->exptime);
+
+    if (slot->count == slot->size) {
+        unsigned int size = slot->size ? slot->size * 2 : 16;
+        wheel_entry_t *entries = realloc(slot->entries,
+                                         size * sizeof(wheel_entry_t));
+        if (entries == NULL)
+            return;
+        slot->entries = entries;
+        slot->size = size;
+    }
+    slot->entries[slot->count++] = *e;
+    w->entries++;
+}
+
+/* Indexes it by its exptime. The caller holds the item lock. */
+static void wheel_add(item *it, const uint32_t hv) {
+    unsigned int id = it->slabs_clsid;
+    wheel_t *w = &wheels[id];
+    wheel_entry_t e;
+
+    if (!settings.expiry_wheel || it->exptime == 0)
+        return;
+    e.it = it;
+    e.hv = hv;
+    e.exptime = it->exptime;
+    mutex_lock(&w->lock);
+    /* The class may have grown since the thread last looked. */
+    if (w->entries >= w->cap && w->cap_time != current_time) {
+        w->cap = wheel_cap(id);
+        w->cap_time = current_time;
+    }
+    if (w->entries < w->cap)
+        wheel_insert(w, &e);
+    mutex_unlock(&w->lock);
+}
+
+/* Number of entries in the wheel of class id. */
+static unsigned int wheel_count(const unsigned int id) {
+    unsigned int entries;
+
+    mutex_lock(&wheels[id].lock);
+    entries = wheels[id].entries;
+    mutex_unlock(&wheels[id].lock);
+    return entries;
+}
+
+/* Empties slot, returning what it held. The caller holds w->lock. */
+static wheel_slot_t wheel_take(wheel_t *w, wheel_slot_t *slot) {
+    wheel_slot_t taken = *slot;
+    memset(slot, 0, sizeof(*slot));
+    w->entries -= taken.count;
+    return taken;
+}
+
+/* Re-files the entries of an upper level slot. Returns the index of the slot
+ * taken, so the caller knows if the next level is due too. The caller holds
+ * w->lock. */
+static int wheel_cascade(wheel_t *w, const int level) {
+    int shift = WHEEL_BITS0 + level * WHEEL_BITS;
+    int index = (w->time >> shift) & (WHEEL_SLOTS - 1);
+    wheel_slot_t taken = wheel_take(w, &w->slots[level][index]);
+    unsigned int i;
+
+    for (i = 0; i < taken.count; i++)
+        wheel_insert(w, &taken.entries[i]);
+    free(taken.entries);
+    return index;
+}
+
+/* Frees the item of e if it's still linked and has expired. Returns false if
+ * the entry should be tried again later, because the item was locked or in
+ * use. */
+static bool wheel_expire(const wheel_entry_t *e) {
+    item *it = e->it;
+    void *hold_lock;
+    bool done = true;
+
+    if ((hold_lock = item_trylock(e->hv)) == NULL)
+        return false;
+    if (assoc_contains(it, e->hv) && it->exptime != 0 &&
+        it->exptime <= current_time) {
+        unsigned int id = it->slabs_clsid;
+        mutex_lock(&lru_locks[id]);
+        /* Only ours and the link's reference: nobody is using it. */
+        if (refcount_incr(&it->refcount) == 2) {
+            itemstats[id].expired_freed++;
+            if ((it->it_flags & ITEM_FETCHED) == 0)
+                itemstats[id].expired_unfetched++;
+            do_item_unlink_nolock(it, e->hv);
+            do_item_remove(it);
+        } else {
+            refcount_decr(&it->refcount);
+            done = false;
+        }
+        mutex_unlock(&lru_locks[id]);
+    }
+    item_trylock_unlock(hold_lock);
+    return done;
+}
+
+/* True if e still stands for a linked item that expires no later than e
+ * says. Entries that fail are dropped by the sweep. */
+static bool wheel_entry_live(const wheel_entry_t *e) {
+    void *hold_lock;
+    bool live;
+
+    if ((hold_lock = item_trylock(e->hv)) == NULL)
+        return true;
+    live = assoc_contains(e->it, e->hv) && e->it->exptime != 0 &&
+        e->it->exptime <= e->exptime;
+    item_trylock_unlock(hold_lock);
+    return live;
+}
+
+/* Expires every second of w up to current_time. */
+static void wheel_run(wheel_t *w) {
+    mutex_lock(&w->lock);
+    while (w->time <= current_time && do_run_expiry_wheel_thread) {
+        wheel_slot_t taken;
+        unsigned int i;
+        int level;
+
+        if ((w->time & (WHEEL_SLOTS0 - 1)) == 0) {
+            for (level = 0; level < WHEEL_LEVELS; level++) {
+                if (wheel_cascade(w, level) != 0)
+                    break;
+            }
+        }
+        taken = wheel_take(w, &w->slots0[w->time & (WHEEL_SLOTS0 - 1)]);
+        w->time++;
+        mutex_unlock(&w->lock);
+
+        for (i = 0; i < taken.count; i++) {
+            if (!wheel_expire(&taken.entries[i])) {
+                /* Try again in a second. */
+                taken.entries[i].exptime = current_time + 1;
+                mutex_lock(&w->lock);
+                wheel_insert(w, &taken.entries[i]);
+                mutex_unlock(&w->lock);
+            }
+        }
+        free(taken.entries);
+        mutex_lock(&w->lock);
+    }
+    mutex_unlock(&w->lock);
+}
+
+/* Drops the entries of one slot whose item is gone or expires later. */
+static void wheel_sweep_slot(wheel_t *w, wheel_slot_t *slot) {
+    wheel_slot_t taken;
+    unsigned int i;
+
+    mutex_lock(&w->lock);
+    taken = wheel_take(w, slot);
+    mutex_unlock(&w->lock);
+
+    for (i = 0; i < taken.count; i++) {
+        if (wheel_entry_live(&taken.entries[i])) {
+            mutex_lock(&w->lock);
+            wheel_insert(w, &taken.entries[i]);
+            mutex_unlock(&w->lock);
+        }
+    }
+    free(taken.entries);
+}
+
+static void wheel_sweep(wheel_t *w) {
+    int level, i;
+
+    for (i = 0; i < WHEEL_SLOTS0; i++)
+        wheel_sweep_slot(w, &w->slots0[i]);
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (i = 0; i < WHEEL_SLOTS; i++)
+            wheel_sweep_slot(w, &w->slots[level][i]);
+    }
+}
+
+static void *expiry_wheel_thread(void *arg) {
+    while (do_run_expiry_wheel_thread) {
+        unsigned int id;
+
+        for (id = POWER_SMALLEST; id < LARGEST_ID; id++) {
+            wheel_t *w = &wheels[id];
+            unsigned int cap = wheel_cap(id);
+            bool sweep;
+
+            wheel_run(w);
+
+            mutex_lock(&w->lock);
+            w->cap = cap;
+            w->cap_time = current_time;
+            sweep = w->entries > cap / 4 * 3;
+            mutex_unlock(&w->lock);
+            if (sweep)
+                wheel_sweep(w);
+        }
+
+        usleep(WHEEL_SLEEP);
+    }
+    return NULL;
+}
+
+int start_expiry_wheel_thread(void) {
+    unsigned int id;
+    int ret;
+
+    for (id = 0; id < LARGEST_ID; id++) {
+        pthread_mutex_init(&wheels[id].lock, NULL);
+        wheels[id].time = current_time;
+        wheels[id].cap = wheel_cap(id);
+    }
+    do_run_expiry_wheel_thread = 1;
+    if ((ret = pthread_create(&expiry_wheel_tid, NULL,
+                              expiry_wheel_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create expiry wheel thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+void stop_expiry_wheel_thread(void) {
+    do_run_expiry_wheel_thread = 0;
+    pthread_join(expiry_wheel_tid, NULL);
 }
@@ -1,28 +1,67 @@
 /* See items.c */
-uint64_t get_cas_id(void);
+uint64_t get_cas_id(const uint64_t min);
+
+/* With -o lru_segmented each slab class has three LRUs. New items go to
+ * HOT; the maintainer thread moves items that were fetched again to WARM and
+ * the rest to COLD, and evictions only come from COLD. Without it, only COLD
+ * is used and behaves as the classic single LRU. */
+enum lru_segment {
+    HOT_LRU = 0,
+    WARM_LRU,
+    COLD_LRU,
+    LRU_SEGMENTS
+};
 
 /*@null@*/
 item *do_item_alloc(char *key, const size_t nkey, const int flags, const rel_time_t exptime, const int nbytes, const uint32_t cur_hv);
+/*@null@*/
+item *do_item_alloc_grow(char *key, const size_t nkey, const int flags, const rel_time_t exptime, const int nbytes, const uint32_t cur_hv);
 void item_free(item *it);
+unsigned int item_reclaim(void);
+void item_limbo_stats(uint64_t *waiting, uint64_t *reclaimed);
+void item_free_chunks(item *it);
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes);
 
+/* Access to values that may be chunked; see item_data_seg() */
+item *item_data_seg(item *it, item *seg, char **data, int *len);
+void item_data_read(item *it, int off, char *dst, int len);
+void item_data_write(item *it, int off, const char *src, int len);
+void item_data_copy(item *dst, int off, item *src, int len);
+int item_counter_ascii(item *it, char *buf);
+int item_value_length(item *it);
+
 int  do_item_link(item *it, const uint32_t hv);     /** may fail if transgresses limits */
 void do_item_unlink(item *it, const uint32_t hv);
 void do_item_unlink_nolock(item *it, const uint32_t hv);
 void do_item_remove(item *it);
 void do_item_update(item *it);   /** update LRU time to current and reposition */
+bool item_update_due(item *it);
 int  do_item_replace(item *it, item *new_it, const uint32_t hv);
-
-/*@null@*/
-char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
-void do_item_stats(ADD_STAT add_stats, void *c);
-void do_item_stats_totals(ADD_STAT add_stats, void *c);
-/*@null@*/
-void do_item_stats_sizes(ADD_STAT add_stats, void *c);
-void do_item_flush_expired(void);
+bool do_item_append(item *old_it, item *it, const bool prepend, const uint32_t hv);
 
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv);
+item *do_item_get_unref(const char *key, const size_t nkey, const uint32_t hv);
+bool item_is_live(item *it);
+bool item_get_optimistic(const char *key, const size_t nkey, const uint32_t hv, item **itp, const bool ref);
 item *do_item_touch(const char *key, const size_t nkey, uint32_t exptime, const uint32_t hv);
 void item_stats_reset(void);
-extern pthread_mutex_t cache_lock;
+extern pthread_mutex_t lru_locks[POWER_LARGEST];
 void item_stats_evictions(uint64_t *evicted);
+
+void item_sketch_init(void);
+void item_count_fetch(const uint32_t hv);
+
+int start_lru_maintainer_thread(void);
+void stop_lru_maintainer_thread(void);
+
+int start_lru_crawler_thread(void);
+void stop_lru_crawler_thread(void);
+
+int start_evictor_thread(void);
+void stop_evictor_thread(void);
+
+int start_expiry_wheel_thread(void);
+void stop_expiry_wheel_thread(void);
+
+int start_prefix_sweep_thread(void);
+void stop_prefix_sweep_thread(void);
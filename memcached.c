@@ -94,6 +94,7 @@ static void process_command(conn *c, char *command);
 static void write_and_free(conn *c, char *buf, int bytes);
 static int ensure_iov_space(conn *c);
 static int add_iov(conn *c, const void *buf, int len);
+static int add_iov_value(conn *c, item *it, int len);
 static int add_msghdr(conn *c);
 
 
@@ -174,6 +175,8 @@ static void stats_init(void) {
     stats.touch_cmds = stats.touch_misses = stats.touch_hits = stats.rejected_conns = 0;
     stats.curr_bytes = stats.listen_disabled_num = 0;
     stats.hash_power_level = stats.hash_bytes = stats.hash_is_expanding = 0;
+    stats.hash_is_shrinking = 0;
+    stats.hash_buckets_moved = 0;
     stats.expired_unfetched = stats.evicted_unfetched = 0;
     stats.slabs_moved = 0;
     stats.accepting_conns = true; /* assuming we start in this state. */
@@ -223,11 +226,27 @@ static void settings_init(void) {
     settings.backlog = 1024;
     settings.binding_protocol = negotiating_prot;
     settings.item_size_max = 1024 * 1024; /* The famous 1MB upper limit. */
+    settings.slab_page_size = 0;      /* set from item_size_max */
+    settings.slab_chunk_max = 0;      /* half a page unless set */
     settings.maxconns_fast = false;
     settings.hashpower_init = 0;
     settings.slab_reassign = false;
     settings.slab_automove = 0;
     settings.shutdown_command = false;
+    settings.optimistic_get = false;
+    settings.hash_layout = HASH_LAYOUT_CHAINED;
+    settings.hash_shrink_pct = 0;
+    settings.lru_segmented = false;
+    settings.hot_lru_pct = 20;
+    settings.warm_lru_pct = 40;
+    settings.lru_mode = LRU_MODE_LIST;
+    settings.lru_crawler = false;
+    settings.lru_crawler_sleep = 100;
+    settings.expiry_wheel = false;
+    settings.hotcache = false;
+    settings.epoch_reclaim = false;
+    settings.evict_reserve = 0;
+    settings.native_counters = false;
 }
 
 /*
@@ -351,6 +370,24 @@ static const char *prot_text(enum protocol prot) {
     return rv;
 }
 
+static const char *const lru_mode_names[] = {
+    [LRU_MODE_LIST] = "lru",
+    [LRU_MODE_CLOCK] = "clock",
+    [LRU_MODE_LFU] = "lfu",
+    [LRU_MODE_TINYLFU] = "tinylfu"
+};
+
+static bool lru_mode_from_name(const char *name, enum lru_mode *mode) {
+    int i;
+    for (i = 0; i < sizeof(lru_mode_names) / sizeof(lru_mode_names[0]); i++) {
+        if (strcmp(name, lru_mode_names[i]) == 0) {
+            *mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
 conn *conn_new(const int sfd, enum conn_states init_state,
                 const int event_flags,
                 const int read_buffer_size, enum network_transport transport,
@@ -433,6 +470,7 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     c->sfd = sfd;
     c->state = init_state;
     c->rlbytes = 0;
+    c->rvleft = 0;
     c->cmd = -1;
     c->rbytes = c->wbytes = 0;
     c->wcurr = c->wbuf;
@@ -441,6 +479,7 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     c->icurr = c->ilist;
     c->suffixcurr = c->suffixlist;
     c->ileft = 0;
+    c->epoch_held = false;
     c->suffixleft = 0;
     c->iovused = 0;
     c->msgcurr = 0;
@@ -451,6 +490,7 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     c->item = 0;
 
     c->noreply = false;
+    c->bin_prefetched = 0;
 
     event_set(&c->event, sfd, event_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
@@ -474,6 +514,36 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     return c;
 }
 
+/* Drops an item a GET handed this connection, unless it was fetched inside
+ * an epoch and holds no reference. */
+static inline void conn_item_release(conn *c, item *it) {
+    if (!c->epoch_held)
+        item_release(c->thread, it);
+}
+
+/* Lets go of the items of a GET reply, leaving the epoch they were fetched
+ * in, if any. */
+static void conn_release_items(conn *c) {
+    for (; c->ileft > 0; c->ileft--, c->icurr++) {
+        assert(((*c->icurr)->it_flags & ITEM_SLABBED) == 0);
+        conn_item_release(c, *(c->icurr));
+    }
+    if (c->epoch_held) {
+        c->epoch_held = false;
+        epoch_exit(c->thread);
+    }
+}
+
+/* The socket can't take the rest of a GET reply for now: takes references
+ * on its items so the worker can leave the epoch meanwhile. */
+static void conn_pin_items(conn *c) {
+    int i;
+    for (i = 0; i < c->ileft; i++)
+        refcount_incr(&c->icurr[i]->refcount);
+    c->epoch_held = false;
+    epoch_exit(c->thread);
+}
+
 static void conn_cleanup(conn *c) {
     assert(c != NULL);
 
@@ -482,11 +552,7 @@ static void conn_cleanup(conn *c) {
         c->item = 0;
     }
 
-    if (c->ileft != 0) {
-        for (; c->ileft > 0; c->ileft--,c->icurr++) {
-            item_remove(*(c->icurr));
-        }
-    }
+    conn_release_items(c);
 
     if (c->suffixleft != 0) {
         for (; c->suffixleft > 0; c->suffixleft--, c->suffixcurr++) {
@@ -745,6 +811,39 @@ static int add_iov(conn *c, const void *buf, int len) {
     return 0;
 }
 
+/*
+ * Adds the first len bytes of an item's value, one iovec per segment of a
+ * chunked value.
+ *
+ * Returns 0 on success, -1 on out-of-memory.
+ */
+static int add_iov_value(conn *c, item *it, int len) {
+    item *seg = NULL;
+    char *data;
+    int seglen;
+
+    while (len > 0 && (seg = item_data_seg(it, seg, &data, &seglen)) != NULL) {
+        if (seglen > len)
+            seglen = len;
+        if (add_iov(c, data, seglen) != 0)
+            return -1;
+        len -= seglen;
+    }
+    return 0;
+}
+
+/*
+ * Sets up conn_nread to read the next len bytes of c->item's value, starting
+ * at the segment after seg (NULL for the first).
+ */
+static void conn_read_value(conn *c, item *seg, int len) {
+    int seglen;
+
+    c->rseg = item_data_seg(c->item, seg, &c->ritem, &seglen);
+    c->rlbytes = seglen < len ? seglen : len;
+    c->rvleft = len - c->rlbytes;
+}
+
 
 /*
  * Constructs a set of UDP headers and attaches them to the outgoing messages.
@@ -840,7 +939,9 @@ static void complete_nread_ascii(conn *c) {
     c->thread->stats.slab_stats[it->slabs_clsid].set_cmds++;
     pthread_mutex_unlock(&c->thread->stats.mutex);
 
-    if (strncmp(ITEM_data(it) + it->nbytes - 2, "\r\n", 2) != 0) {
+    char crlf[2];
+    item_data_read(it, it->nbytes - 2, crlf, 2);
+    if (memcmp(crlf, "\r\n", 2) != 0) {
         out_string(c, "CLIENT_ERROR bad data chunk");
     } else {
       ret = store_item(it, comm, c);
@@ -1090,11 +1191,17 @@ static void complete_incr_bin(conn *c) {
             /* Save some room for the response */
             rsp->message.body.value = htonll(req->message.body.initial);
             it = item_alloc(key, nkey, 0, realtime(req->message.body.expiration),
-                            INCR_MAX_STORAGE_LEN);
+                            settings.native_counters ? ITEM_COUNTER_BYTES
+                            : INCR_MAX_STORAGE_LEN);
 
             if (it != NULL) {
-                snprintf(ITEM_data(it), INCR_MAX_STORAGE_LEN, "%llu",
-                         (unsigned long long)req->message.body.initial);
+                if (settings.native_counters) {
+                    it->it_flags |= ITEM_COUNTER;
+                    item_counter_set(it, req->message.body.initial);
+                } else {
+                    snprintf(ITEM_data(it), INCR_MAX_STORAGE_LEN, "%llu",
+                             (unsigned long long)req->message.body.initial);
+                }
 
                 if (store_item(it, NREAD_ADD, c)) {
                     c->cas = ITEM_get_cas(it);
@@ -1137,8 +1244,7 @@ static void complete_update_bin(conn *c) {
 
     /* We don't actually receive the trailing two characters in the bin
      * protocol, so we're going to just set them here */
-    *(ITEM_data(it) + it->nbytes - 2) = '\r';
-    *(ITEM_data(it) + it->nbytes - 1) = '\n';
+    item_data_write(it, it->nbytes - 2, "\r\n", 2);
 
     ret = store_item(it, c->cmd, c);
 
@@ -1194,6 +1300,23 @@ static void complete_update_bin(conn *c) {
     c->item = 0;
 }
 
+/* The length of it's value in a binary response, without the CRLF. A
+ * native counter is rendered into wbuf, after the rsp_size bytes of the
+ * response, for add_bin_value() to send. */
+static int bin_value_length(conn *c, item *it, const size_t rsp_size) {
+    if (it->it_flags & ITEM_COUNTER)
+        return item_counter_ascii(it, c->wbuf + rsp_size);
+    return it->nbytes - 2;
+}
+
+/* Adds the vlen bytes of it's value bin_value_length() found. */
+static int add_bin_value(conn *c, item *it, const size_t rsp_size,
+                         const int vlen) {
+    if (it->it_flags & ITEM_COUNTER)
+        return add_iov(c, c->wbuf + rsp_size, vlen);
+    return add_iov_value(c, it, vlen);
+}
+
 static void process_bin_touch(conn *c) {
     item *it;
 
@@ -1216,9 +1339,9 @@ static void process_bin_touch(conn *c) {
     it = item_touch(key, nkey, realtime(exptime));
 
     if (it) {
-        /* the length has two unnecessary bytes ("\r\n") */
         uint16_t keylen = 0;
-        uint32_t bodylen = sizeof(rsp->message.body) + (it->nbytes - 2);
+        int vlen = bin_value_length(c, it, sizeof(*rsp));
+        uint32_t bodylen = sizeof(rsp->message.body) + vlen;
 
         item_update(it);
         pthread_mutex_lock(&c->thread->stats.mutex);
@@ -1230,7 +1353,7 @@ static void process_bin_touch(conn *c) {
                                 it->nbytes, ITEM_get_cas(it));
 
         if (c->cmd == PROTOCOL_BINARY_CMD_TOUCH) {
-            bodylen -= it->nbytes - 2;
+            bodylen -= vlen;
         } else if (c->cmd == PROTOCOL_BINARY_CMD_GATK) {
             bodylen += nkey;
             keylen = nkey;
@@ -1240,16 +1363,15 @@ static void process_bin_touch(conn *c) {
         rsp->message.header.response.cas = htonll(ITEM_get_cas(it));
 
         // add the flags
-        rsp->message.body.flags = htonl(strtoul(ITEM_suffix(it), NULL, 10));
+        rsp->message.body.flags = htonl(ITEM_get_flags(it));
         add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
         if (c->cmd == PROTOCOL_BINARY_CMD_GATK) {
             add_iov(c, ITEM_key(it), nkey);
         }
 
-        /* Add the data minus the CRLF */
         if (c->cmd != PROTOCOL_BINARY_CMD_TOUCH) {
-            add_iov(c, ITEM_data(it), it->nbytes - 2);
+            add_bin_value(c, it, sizeof(*rsp), vlen);
         }
 
         conn_set_state(c, conn_mwrite);
@@ -1304,9 +1426,9 @@ static void process_bin_get(conn *c) {
 
     it = item_get(key, nkey);
     if (it) {
-        /* the length has two unnecessary bytes ("\r\n") */
         uint16_t keylen = 0;
-        uint32_t bodylen = sizeof(rsp->message.body) + (it->nbytes - 2);
+        int vlen = bin_value_length(c, it, sizeof(*rsp));
+        uint32_t bodylen = sizeof(rsp->message.body) + vlen;
 
         item_update(it);
         pthread_mutex_lock(&c->thread->stats.mutex);
@@ -1325,15 +1447,14 @@ static void process_bin_get(conn *c) {
         rsp->message.header.response.cas = htonll(ITEM_get_cas(it));
 
         // add the flags
-        rsp->message.body.flags = htonl(strtoul(ITEM_suffix(it), NULL, 10));
+        rsp->message.body.flags = htonl(ITEM_get_flags(it));
         add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
         if (c->cmd == PROTOCOL_BINARY_CMD_GETK) {
             add_iov(c, ITEM_key(it), nkey);
         }
 
-        /* Add the data minus the CRLF */
-        add_iov(c, ITEM_data(it), it->nbytes - 2);
+        add_bin_value(c, it, sizeof(*rsp), vlen);
         conn_set_state(c, conn_mwrite);
         c->write_and_go = conn_new_cmd;
         /* Remember this command so we can garbage collect it later */
@@ -1680,9 +1801,16 @@ static void process_bin_sasl_auth(conn *c) {
         return;
     }
 
+    /* Auth data is read in one piece */
+    if (it->it_flags & ITEM_CHUNKED) {
+        item_remove(it);
+        write_bin_error(c, PROTOCOL_BINARY_RESPONSE_EINVAL, vlen);
+        c->write_and_go = conn_swallow;
+        return;
+    }
+
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = vlen;
+    conn_read_value(c, NULL, vlen);
     conn_set_state(c, conn_nread);
     c->substate = bin_reading_sasl_auth_data;
 }
@@ -1790,6 +1918,59 @@ static bool authenticated(conn *c) {
     return rv;
 }
 
+/*
+ * Binary clients do a multiget as a run of GETQ/GETKQ packets, usually
+ * ended by a GET or NOOP. On the first quiet get of a run, hash and
+ * prefetch the keys of every complete get packet already in the read
+ * buffer, so their bucket misses overlap rather than each get paying its
+ * own when process_bin_get() reaches it.
+ */
+static void bin_prefetch_gets(conn *c) {
+    char *keys[ITEM_BATCH_MAX];
+    size_t nkeys[ITEM_BATCH_MAX];
+    uint32_t hvs[ITEM_BATCH_MAX];
+    protocol_binary_request_header req;
+    char *p = c->rcurr;
+    char *end = c->rcurr + c->rbytes;
+    int count = 0;
+
+    if (c->bin_prefetched > 0) {
+        /* Covered by an earlier packet of this run. */
+        c->bin_prefetched--;
+        return;
+    }
+    if (c->binary_header.request.opcode != PROTOCOL_BINARY_CMD_GETQ &&
+        c->binary_header.request.opcode != PROTOCOL_BINARY_CMD_GETKQ) {
+        return;
+    }
+
+    while (count < ITEM_BATCH_MAX && end - p >= sizeof(req)) {
+        uint16_t keylen;
+        uint32_t bodylen;
+
+        memcpy(&req, p, sizeof(req));
+        keylen = ntohs(req.request.keylen);
+        bodylen = ntohl(req.request.bodylen);
+        if (req.request.magic != PROTOCOL_BINARY_REQ ||
+            (req.request.opcode != PROTOCOL_BINARY_CMD_GET &&
+             req.request.opcode != PROTOCOL_BINARY_CMD_GETQ &&
+             req.request.opcode != PROTOCOL_BINARY_CMD_GETK &&
+             req.request.opcode != PROTOCOL_BINARY_CMD_GETKQ) ||
+            req.request.extlen != 0 || bodylen != keylen || keylen == 0 ||
+            keylen > KEY_MAX_LENGTH || end - p - sizeof(req) < bodylen) {
+            break;
+        }
+        keys[count] = p + sizeof(req);
+        nkeys[count] = keylen;
+        count++;
+        p += sizeof(req) + bodylen;
+    }
+
+    item_prefetch_batch(keys, nkeys, hvs, count);
+    /* The first key is this packet's own. */
+    c->bin_prefetched = count > 1 ? count - 1 : 0;
+}
+
 static void dispatch_bin_command(conn *c) {
     int protocol_error = 0;
 
@@ -1895,6 +2076,7 @@ static void dispatch_bin_command(conn *c) {
         case PROTOCOL_BINARY_CMD_GETKQ: /* FALLTHROUGH */
         case PROTOCOL_BINARY_CMD_GETK:
             if (extlen == 0 && bodylen == keylen && keylen > 0) {
+                bin_prefetch_gets(c);
                 bin_read_key(c, bin_reading_get_key, 0);
             } else {
                 protocol_error = 1;
@@ -2060,8 +2242,7 @@ static void process_bin_update(conn *c) {
     }
 
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = vlen;
+    conn_read_value(c, NULL, vlen);
     conn_set_state(c, conn_nread);
     c->substate = bin_read_set_value;
 }
@@ -2113,8 +2294,7 @@ static void process_bin_append_prepend(conn *c) {
     }
 
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = vlen;
+    conn_read_value(c, NULL, vlen);
     conn_set_state(c, conn_nread);
     c->substate = bin_read_set_value;
 }
@@ -2129,10 +2309,11 @@ static void process_bin_flush(conn *c) {
 
     if (exptime > 0) {
         settings.oldest_live = realtime(exptime) - 1;
+        item_flush(realtime(exptime));
     } else {
         settings.oldest_live = current_time - 1;
+        item_flush(0);
     }
-    item_flush_expired();
 
     pthread_mutex_lock(&c->thread->stats.mutex);
     c->thread->stats.flush_cmds++;
@@ -2322,13 +2503,29 @@ enum store_item_type do_store_item(item *it, int comm, conn *c, const uint32_t h
                 }
             }
 
+            /* Reuse old_it if its chunk has room to spare */
+            if (stored == NOT_STORED &&
+                do_item_append(old_it, it, comm == NREAD_PREPEND, hv)) {
+                it = old_it;
+                stored = STORED;
+            }
+
             if (stored == NOT_STORED) {
                 /* we have it and old_it here - alloc memory to hold both */
-                /* flags was already lost - so recover them from ITEM_suffix(it) */
-
-                flags = (int) strtol(ITEM_suffix(old_it), (char **) NULL, 10);
+                /* flags was already lost - so take them from old_it */
+                char counter[INCR_MAX_STORAGE_LEN + 2];
+                int old_nbytes = old_it->nbytes;
+
+                flags = (int) ITEM_get_flags(old_it);
+                /* A native counter becomes ASCII again */
+                if (old_it->it_flags & ITEM_COUNTER) {
+                    old_nbytes = item_counter_ascii(old_it, counter);
+                    memcpy(counter + old_nbytes, "\r\n", 2);
+                    old_nbytes += 2;
+                }
 
-                new_it = do_item_alloc(key, it->nkey, flags, old_it->exptime, it->nbytes + old_it->nbytes - 2 /* CRLF */, hv);
+                /* Leave room for the next append to be done in place */
+                new_it = do_item_alloc_grow(key, it->nkey, flags, old_it->exptime, it->nbytes + old_nbytes - 2 /* CRLF */, hv);
 
                 if (new_it == NULL) {
                     /* SERVER_ERROR out of memory */
@@ -2341,12 +2538,18 @@ enum store_item_type do_store_item(item *it, int comm, conn *c, const uint32_t h
                 /* copy data from it and old_it to new_it */
 
                 if (comm == NREAD_APPEND) {
-                    memcpy(ITEM_data(new_it), ITEM_data(old_it), old_it->nbytes);
-                    memcpy(ITEM_data(new_it) + old_it->nbytes - 2 /* CRLF */, ITEM_data(it), it->nbytes);
+                    if (old_it->it_flags & ITEM_COUNTER)
+                        item_data_write(new_it, 0, counter, old_nbytes);
+                    else
+                        item_data_copy(new_it, 0, old_it, old_nbytes);
+                    item_data_copy(new_it, old_nbytes - 2 /* CRLF */, it, it->nbytes);
                 } else {
                     /* NREAD_PREPEND */
-                    memcpy(ITEM_data(new_it), ITEM_data(it), it->nbytes);
-                    memcpy(ITEM_data(new_it) + it->nbytes - 2 /* CRLF */, ITEM_data(old_it), old_it->nbytes);
+                    item_data_copy(new_it, 0, it, it->nbytes);
+                    if (old_it->it_flags & ITEM_COUNTER)
+                        item_data_write(new_it, it->nbytes - 2 /* CRLF */, counter, old_nbytes);
+                    else
+                        item_data_copy(new_it, it->nbytes - 2 /* CRLF */, old_it, old_nbytes);
                 }
 
                 it = new_it;
@@ -2528,6 +2731,8 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     threadlocal_stats_aggregate(&thread_stats);
     struct slab_stats slab_stats;
     slab_stats_aggregate(&thread_stats, &slab_stats);
+    uint64_t limbo_items, limbo_reclaimed;
+    item_limbo_stats(&limbo_items, &limbo_reclaimed);
 
 #ifndef WIN32
     struct rusage usage;
@@ -2588,10 +2793,16 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     APPEND_STAT("hash_power_level", "%u", stats.hash_power_level);
     APPEND_STAT("hash_bytes", "%llu", (unsigned long long)stats.hash_bytes);
     APPEND_STAT("hash_is_expanding", "%u", stats.hash_is_expanding);
+    APPEND_STAT("hash_is_shrinking", "%u", stats.hash_is_shrinking);
+    APPEND_STAT("hash_buckets_moved", "%u", stats.hash_buckets_moved);
     if (settings.slab_reassign) {
         APPEND_STAT("slab_reassign_running", "%u", stats.slab_reassign_running);
         APPEND_STAT("slabs_moved", "%llu", stats.slabs_moved);
     }
+    if (settings.epoch_reclaim) {
+        APPEND_STAT("epoch_limbo_items", "%llu", (unsigned long long)limbo_items);
+        APPEND_STAT("epoch_reclaimed", "%llu", (unsigned long long)limbo_reclaimed);
+    }
     STATS_UNLOCK();
 }
 
@@ -2622,10 +2833,41 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
                 prot_text(settings.binding_protocol));
     APPEND_STAT("auth_enabled_sasl", "%s", settings.sasl ? "yes" : "no");
     APPEND_STAT("item_size_max", "%d", settings.item_size_max);
+    APPEND_STAT("slab_page_size", "%d", settings.slab_page_size);
+    APPEND_STAT("slab_chunk_max", "%d", settings.slab_chunk_max);
     APPEND_STAT("maxconns_fast", "%s", settings.maxconns_fast ? "yes" : "no");
     APPEND_STAT("hashpower_init", "%d", settings.hashpower_init);
     APPEND_STAT("slab_reassign", "%s", settings.slab_reassign ? "yes" : "no");
     APPEND_STAT("slab_automove", "%d", settings.slab_automove);
+    APPEND_STAT("optimistic_get", "%s", settings.optimistic_get ? "yes" : "no");
+    APPEND_STAT("hash_layout", "%s",
+                settings.hash_layout == HASH_LAYOUT_BUCKETED ? "bucketed" : "chained");
+    APPEND_STAT("hash_algorithm", "%s", hash_algorithm());
+    APPEND_STAT("hash_shrink_pct", "%d", settings.hash_shrink_pct);
+    APPEND_STAT("lru_segmented", "%s", settings.lru_segmented ? "yes" : "no");
+    APPEND_STAT("hot_lru_pct", "%d", settings.hot_lru_pct);
+    APPEND_STAT("warm_lru_pct", "%d", settings.warm_lru_pct);
+    APPEND_STAT("lru_mode", "%s", lru_mode_names[settings.lru_mode]);
+    APPEND_STAT("lru_crawler", "%s", settings.lru_crawler ? "yes" : "no");
+    APPEND_STAT("lru_crawler_sleep", "%d", settings.lru_crawler_sleep);
+    APPEND_STAT("expiry_wheel", "%s", settings.expiry_wheel ? "yes" : "no");
+    APPEND_STAT("hotcache", "%s", settings.hotcache ? "yes" : "no");
+    APPEND_STAT("epoch_reclaim", "%s", settings.epoch_reclaim ? "yes" : "no");
+    APPEND_STAT("evict_reserve", "%d", settings.evict_reserve);
+    APPEND_STAT("native_counters", "%s", settings.native_counters ? "yes" : "no");
+}
+
+/* "stats hotcache": how the per-thread hot item caches are doing. */
+static void process_stat_hotcache(ADD_STAT add_stats, void *c) {
+    struct thread_stats thread_stats;
+
+    threadlocal_stats_aggregate(&thread_stats);
+    APPEND_STAT("enabled", "%s", settings.hotcache ? "yes" : "no");
+    APPEND_STAT("hits", "%llu", (unsigned long long)thread_stats.hotcache_hits);
+    APPEND_STAT("validation_fails", "%llu",
+                (unsigned long long)thread_stats.hotcache_invalid);
+    APPEND_STAT("evictions", "%llu",
+                (unsigned long long)thread_stats.hotcache_evictions);
 }
 
 static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
@@ -2654,6 +2896,8 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
         return ;
     } else if (strcmp(subcommand, "settings") == 0) {
         process_stat_settings(&append_stats, c);
+    } else if (strcmp(subcommand, "hotcache") == 0) {
+        process_stat_hotcache(&append_stats, c);
     } else if (strcmp(subcommand, "cachedump") == 0) {
         char *buf;
         unsigned int bytes, id, limit = 0;
@@ -2704,28 +2948,84 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
     }
 }
 
-/* ntokens is overwritten here... shrug.. */
+/* Drops the references item_get_batch() handed out for count items. */
+static void item_remove_batch(conn *c, item **items, const int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (items[i] != NULL)
+            conn_item_release(c, items[i]);
+    }
+}
+
+/* Writes the " flags length[ cas]\r\n" end of a VALUE line for it into
+ * suffix, which holds SUFFIX_SIZE bytes, and returns its length. For a
+ * native counter, the value and its \r\n follow. */
+static inline int make_ascii_get_suffix(char *suffix, item *it,
+                                        const bool return_cas) {
+    if (it->it_flags & ITEM_COUNTER) {
+        char value[INCR_MAX_STORAGE_LEN];
+        int vlen = item_counter_ascii(it, value);
+        if (return_cas) {
+            return snprintf(suffix, SUFFIX_SIZE, " %u %d %llu\r\n%s\r\n",
+                            ITEM_get_flags(it), vlen,
+                            (unsigned long long)ITEM_get_cas(it), value);
+        }
+        return snprintf(suffix, SUFFIX_SIZE, " %u %d\r\n%s\r\n",
+                        ITEM_get_flags(it), vlen, value);
+    }
+    if (return_cas) {
+        return snprintf(suffix, SUFFIX_SIZE, " %u %d %llu\r\n",
+                        ITEM_get_flags(it), it->nbytes - 2,
+                        (unsigned long long)ITEM_get_cas(it));
+    }
+    return snprintf(suffix, SUFFIX_SIZE, " %u %d\r\n",
+                    ITEM_get_flags(it), it->nbytes - 2);
+}
+
 static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas) {
     char *key;
     size_t nkey;
     int i = 0;
     item *it;
     token_t *key_token = &tokens[KEY_TOKEN];
+    token_t key_tokens[ITEM_BATCH_MAX + 1];
+    char *batch_keys[ITEM_BATCH_MAX];
+    size_t batch_nkeys[ITEM_BATCH_MAX];
+    item *batch_items[ITEM_BATCH_MAX];
+    int nbatch, b;
     char *suffix;
     assert(c != NULL);
 
+    if (settings.epoch_reclaim && !c->epoch_held) {
+        c->epoch_held = true;
+        epoch_enter(c->thread);
+    }
+
     do {
+        /* Look up this run of keys in one go; item_get_batch() overlaps
+         * their hash table misses. */
+        for (nbatch = 0; key_token[nbatch].length != 0 &&
+                 key_token[nbatch].length <= KEY_MAX_LENGTH; nbatch++) {
+            batch_keys[nbatch] = key_token[nbatch].value;
+            batch_nkeys[nbatch] = key_token[nbatch].length;
+        }
+        item_get_batch(c->thread, batch_keys, batch_nkeys, batch_items, nbatch);
+        b = 0;
+
         while(key_token->length != 0) {
 
             key = key_token->value;
             nkey = key_token->length;
 
             if(nkey > KEY_MAX_LENGTH) {
+                c->icurr = c->ilist;
+                c->ileft = i;
+                conn_release_items(c);
                 out_string(c, "CLIENT_ERROR bad command line format");
                 return;
             }
 
-            it = item_get(key, nkey);
+            it = batch_items[b++];
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
             }
@@ -2736,69 +3036,60 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                         c->isize *= 2;
                         c->ilist = new_list;
                     } else {
-                        item_remove(it);
+                        conn_item_release(c, it);
                         break;
                     }
                 }
 
                 /*
-                 * Construct the response. Each hit adds three elements to the
+                 * Construct the response. Each hit adds four elements to the
                  * outgoing data list:
                  *   "VALUE "
                  *   key
-                 *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
+                 *   " " + flags + " " + data length [+ " " + cas] + "\r\n"
+                 *   data (with \r\n)
+                 * A native counter's data is rendered into the suffix.
                  */
 
-                if (return_cas)
-                {
-                  MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
-                                        it->nbytes, ITEM_get_cas(it));
-                  /* Goofy mid-flight realloc. */
-                  if (i >= c->suffixsize) {
+                MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
+                                      it->nbytes, ITEM_get_cas(it));
+                /* Goofy mid-flight realloc. */
+                if (i >= c->suffixsize) {
                     char **new_suffix_list = realloc(c->suffixlist,
                                            sizeof(char *) * c->suffixsize * 2);
                     if (new_suffix_list) {
                         c->suffixsize *= 2;
                         c->suffixlist  = new_suffix_list;
                     } else {
-                        item_remove(it);
+                        conn_item_release(c, it);
                         break;
                     }
-                  }
+                }
 
-                  suffix = cache_alloc(c->thread->suffix_cache);
-                  if (suffix == NULL) {
-                    out_string(c, "SERVER_ERROR out of memory making CAS suffix");
-                    item_remove(it);
+                suffix = cache_alloc(c->thread->suffix_cache);
+                if (suffix == NULL) {
+                    conn_item_release(c, it);
+                    item_remove_batch(c, batch_items + b, nbatch - b);
+                    c->icurr = c->ilist;
+                    c->ileft = i;
+                    conn_release_items(c);
+                    while (i > 0)
+                        cache_free(c->thread->suffix_cache, c->suffixlist[--i]);
+                    out_string(c, "SERVER_ERROR out of memory writing get response");
                     return;
-                  }
-                  *(c->suffixlist + i) = suffix;
-                  int suffix_len = snprintf(suffix, SUFFIX_SIZE,
-                                            " %llu\r\n",
-                                            (unsigned long long)ITEM_get_cas(it));
-                  if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, ITEM_key(it), it->nkey) != 0 ||
-                      add_iov(c, ITEM_suffix(it), it->nsuffix - 2) != 0 ||
-                      add_iov(c, suffix, suffix_len) != 0 ||
-                      add_iov(c, ITEM_data(it), it->nbytes) != 0)
-                      {
-                          item_remove(it);
-                          break;
-                      }
-                }
-                else
-                {
-                  MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
-                                        it->nbytes, ITEM_get_cas(it));
-                  if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, ITEM_key(it), it->nkey) != 0 ||
-                      add_iov(c, ITEM_suffix(it), it->nsuffix + it->nbytes) != 0)
-                      {
-                          item_remove(it);
-                          break;
-                      }
                 }
-
+                int suffix_len = make_ascii_get_suffix(suffix, it, return_cas);
+                if (add_iov(c, "VALUE ", 6) != 0 ||
+                    add_iov(c, ITEM_key(it), it->nkey) != 0 ||
+                    add_iov(c, suffix, suffix_len) != 0 ||
+                    ((it->it_flags & ITEM_COUNTER) == 0 &&
+                     add_iov_value(c, it, it->nbytes) != 0))
+                    {
+                        cache_free(c->thread->suffix_cache, suffix);
+                        conn_item_release(c, it);
+                        break;
+                    }
+                *(c->suffixlist + i) = suffix;
 
                 if (settings.verbose > 1)
                     fprintf(stderr, ">%d sending key %s\n", c->sfd, ITEM_key(it));
@@ -2822,24 +3113,24 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
 
             key_token++;
         }
+        /* Release whatever a break above left unsent. */
+        item_remove_batch(c, batch_items + b, nbatch - b);
 
         /*
          * If the command string hasn't been fully processed, get the next set
          * of tokens.
          */
         if(key_token->value != NULL) {
-            ntokens = tokenize_command(key_token->value, tokens, MAX_TOKENS);
-            key_token = tokens;
+            tokenize_command(key_token->value, key_tokens, ITEM_BATCH_MAX + 1);
+            key_token = key_tokens;
         }
 
     } while(key_token->value != NULL);
 
     c->icurr = c->ilist;
     c->ileft = i;
-    if (return_cas) {
-        c->suffixcurr = c->suffixlist;
-        c->suffixleft = i;
-    }
+    c->suffixcurr = c->suffixlist;
+    c->suffixleft = i;
 
     if (settings.verbose > 1)
         fprintf(stderr, ">%d END\n", c->sfd);
@@ -2851,6 +3142,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
     */
     if (key_token->value != NULL || add_iov(c, "END\r\n", 5) != 0
         || (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
+        conn_release_items(c);
         out_string(c, "SERVER_ERROR out of memory writing get response");
     }
     else {
@@ -2943,8 +3235,7 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
     ITEM_set_cas(it, req_cas_id);
 
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = it->nbytes;
+    conn_read_value(c, NULL, it->nbytes);
     c->cmd = comm;
     conn_set_state(c, conn_nread);
 }
@@ -3072,11 +3363,19 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
         return DELTA_ITEM_CAS_MISMATCH;
     }
 
-    ptr = ITEM_data(it);
-
-    if (!safe_strtoull(ptr, &value)) {
+    if (it->it_flags & ITEM_COUNTER) {
+        value = item_counter_get(it);
+    } else if (it->it_flags & ITEM_CHUNKED) {
+        /* Far too long for a number */
         do_item_remove(it);
         return NON_NUMERIC;
+    } else {
+        ptr = ITEM_data(it);
+
+        if (!safe_strtoull(ptr, &value)) {
+            do_item_remove(it);
+            return NON_NUMERIC;
+        }
     }
 
     if (incr) {
@@ -3101,15 +3400,28 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
 
     snprintf(buf, INCR_MAX_STORAGE_LEN, "%llu", (unsigned long long)value);
     res = strlen(buf);
-    if (res + 2 > it->nbytes || it->refcount != 1) { /* need to realloc */
+    if (it->it_flags & ITEM_COUNTER) {
+        /* Readers take the value with an atomic load, whether they hold a
+           reference or not, so it's always updated in place. */
+        item_counter_set(it, value);
+        ITEM_set_cas(it, (settings.use_cas) ? get_cas_id(ITEM_get_cas(it)) : 0);
+        do_item_update(it);
+    } else if (settings.native_counters || res + 2 > it->nbytes ||
+               it->refcount != 1) { /* need to realloc */
         item *new_it;
-        new_it = do_item_alloc(ITEM_key(it), it->nkey, atoi(ITEM_suffix(it) + 1), it->exptime, res + 2, hv);
+        new_it = do_item_alloc(ITEM_key(it), it->nkey, ITEM_get_flags(it), it->exptime,
+                               settings.native_counters ? ITEM_COUNTER_BYTES : res + 2, hv);
         if (new_it == 0) {
             do_item_remove(it);
             return EOM;
         }
-        memcpy(ITEM_data(new_it), buf, res);
-        memcpy(ITEM_data(new_it) + res, "\r\n", 2);
+        if (settings.native_counters) {
+            new_it->it_flags |= ITEM_COUNTER;
+            item_counter_set(new_it, value);
+        } else {
+            memcpy(ITEM_data(new_it), buf, res);
+            memcpy(ITEM_data(new_it) + res, "\r\n", 2);
+        }
         item_replace(it, new_it, hv);
         // Overwrite the older item's CAS with our new CAS since we're
         // returning the CAS of the old item below.
@@ -3118,9 +3430,7 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
     } else { /* replace in-place */
         /* When changing the value without replacing the item, we
            need to update the CAS on the existing item. */
-        mutex_lock(&cache_lock); /* FIXME */
-        ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
-        mutex_unlock(&cache_lock);
+        ITEM_set_cas(it, (settings.use_cas) ? get_cas_id(ITEM_get_cas(it)) : 0);
 
         memcpy(ITEM_data(it), buf, res);
         memset(ITEM_data(it) + res, ' ', it->nbytes - res - 2);
@@ -3343,7 +3653,7 @@ static void process_command(conn *c, char *command) {
 
         if(ntokens == (c->noreply ? 3 : 2)) {
             settings.oldest_live = current_time - 1;
-            item_flush_expired();
+            item_flush(0);
             out_string(c, "OK");
             return;
         }
@@ -3360,14 +3670,58 @@ static void process_command(conn *c, char *command) {
           value.  So we process exptime == 0 the same way we do when
           no delay is given at all.
         */
-        if (exptime > 0)
+        if (exptime > 0) {
             settings.oldest_live = realtime(exptime) - 1;
-        else /* exptime == 0 */
+            item_flush(realtime(exptime));
+        } else { /* exptime == 0 */
             settings.oldest_live = current_time - 1;
-        item_flush_expired();
+            item_flush(0);
+        }
         out_string(c, "OK");
         return;
 
+    } else if ((ntokens == 3 || ntokens == 4) && (strcmp(tokens[COMMAND_TOKEN].value, "flush_prefix") == 0)) {
+
+        if (!set_noreply_maybe(c, tokens, ntokens) && ntokens == 4) {
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        if (tokens[KEY_TOKEN].length > KEY_MAX_LENGTH) {
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        if (!settings.use_cas) {
+            out_string(c, "SERVER_ERROR flush_prefix needs CAS enabled");
+        } else if (!item_flush_prefix(tokens[KEY_TOKEN].value,
+                                      tokens[KEY_TOKEN].length)) {
+            out_string(c, "SERVER_ERROR out of memory");
+        } else {
+            out_string(c, "OK");
+        }
+        return;
+
+    } else if ((ntokens == 3 || ntokens == 4) && (strcmp(tokens[COMMAND_TOKEN].value, "keys") == 0)) {
+        char *buf;
+        uint32_t cursor, count = 100;
+        unsigned int bytes;
+
+        if (!safe_strtoul(tokens[1].value, &cursor) ||
+            (ntokens == 4 && !safe_strtoul(tokens[2].value, &count)) ||
+            count == 0 || count > 10000) {
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        buf = item_keys(&cursor, count, &bytes);
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        write_and_free(c, buf, bytes);
+        return;
+
     } else if (ntokens == 2 && (strcmp(tokens[COMMAND_TOKEN].value, "version") == 0)) {
 
         out_string(c, "VERSION " VERSION);
@@ -3917,6 +4271,11 @@ static void drive_machine(conn *c) {
 
         case conn_nread:
             if (c->rlbytes == 0) {
+                if (c->rvleft > 0) {
+                    /* on to the next chunk of the value */
+                    conn_read_value(c, c->rseg, c->rvleft);
+                    break;
+                }
                 complete_nread(c);
                 break;
             }
@@ -4046,13 +4405,7 @@ static void drive_machine(conn *c) {
             switch (transmit(c)) {
             case TRANSMIT_COMPLETE:
                 if (c->state == conn_mwrite) {
-                    while (c->ileft > 0) {
-                        item *it = *(c->icurr);
-                        assert((it->it_flags & ITEM_SLABBED) == 0);
-                        item_remove(it);
-                        c->icurr++;
-                        c->ileft--;
-                    }
+                    conn_release_items(c);
                     while (c->suffixleft > 0) {
                         char *suffix = *(c->suffixcurr);
                         cache_free(c->thread->suffix_cache, suffix);
@@ -4083,6 +4436,8 @@ static void drive_machine(conn *c) {
                 break;                   /* Continue in state machine. */
 
             case TRANSMIT_SOFT_ERROR:
+                if (c->epoch_held)
+                    conn_pin_items(c);
                 stop = true;
                 break;
             }
@@ -4489,6 +4844,7 @@ static void clock_handler(const int fd, const short which, void *arg) {
         if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
             return;
         current_time = (rel_time_t) (ts.tv_sec - monotonic_start);
+        item_flush_tick();
         return;
     }
 #endif
@@ -4497,6 +4853,7 @@ static void clock_handler(const int fd, const short which, void *arg) {
         gettimeofday(&tv, NULL);
         current_time = (rel_time_t) (tv.tv_sec - process_started);
     }
+    item_flush_tick();
 }
 
 static void usage(void) {
@@ -4549,8 +4906,9 @@ static void usage(void) {
     printf("-C            Disable use of CAS\n");
     printf("-b            Set the backlog queue limit (default: 1024)\n");
     printf("-B            Binding protocol - one of ascii, binary, or auto (default)\n");
-    printf("-I            Override the size of each slab page. Adjusts max item size\n"
-           "              (default: 1mb, min: 1k, max: 128m)\n");
+    printf("-I            Override the max item size (default: 1mb, min: 1k,\n"
+           "              max: 128m). Slab pages are this size up to 1mb; bigger\n"
+           "              items are stored in chunks.\n");
 #ifdef ENABLE_SASL
     printf("-S            Turn on Sasl authentication\n");
 #endif
@@ -4561,6 +4919,64 @@ static void usage(void) {
            "                table should be. Can be grown at runtime if not big enough.\n"
            "                Set this based on \"STAT hash_power_level\" before a \n"
            "                restart.\n"
+           "              - optimistic_get: look up items on GET without taking\n"
+           "                the item lock, falling back to it on contention.\n"
+           "              - hash_layout: chained (default) or bucketed. Bucketed\n"
+           "                packs item pointers and hash tags in cache line sized\n"
+           "                buckets so lookups touch fewer cache lines, at the cost\n"
+           "                of a larger table.\n"
+           "              - hash_algorithm: key hash, one of jenkins (default),\n"
+           "                murmur3, crc32c or siphash. crc32c uses the SSE4.2\n"
+           "                instruction when the CPU has it. siphash is keyed\n"
+           "                with a random secret so clients can't flood one\n"
+           "                hash chain.\n"
+           "              - hash_shrink_pct: halve the hash table in the\n"
+           "                background once it holds fewer items than this\n"
+           "                percentage of what would make it grow (0-25,\n"
+           "                default 0 = never). It won't go below its\n"
+           "                starting size.\n"
+           "              - lru_segmented: split each slab class's LRU into\n"
+           "                hot, warm and cold parts kept in order by a\n"
+           "                background thread. Hits don't take the LRU lock and\n"
+           "                evictions only come from cold, so a scan can't push\n"
+           "                out items that are being reused.\n"
+           "              - hot_lru_pct: share of a class's items kept hot\n"
+           "                (default 20)\n"
+           "              - warm_lru_pct: share of a class's items kept warm\n"
+           "                (default 40)\n"
+           "              - lru_mode: lru (default), clock, lfu or tinylfu.\n"
+           "                With clock, a hit only sets an access bit on the\n"
+           "                item, and evictions sweep a clock hand over the\n"
+           "                class, sparing items whose bit was set once. lfu\n"
+           "                evicts whichever of the oldest few items was\n"
+           "                asked for least lately. tinylfu needs\n"
+           "                lru_segmented: an eviction takes the oldest hot\n"
+           "                item instead of the oldest cold one unless the\n"
+           "                hot one was asked for more.\n"
+           "              - lru_crawler: walk the LRUs in a background thread\n"
+           "                and reclaim expired items before they have to be\n"
+           "                found.\n"
+           "              - lru_crawler_sleep: microseconds the crawler sleeps\n"
+           "                after every 100 items it checks (default 100)\n"
+           "              - expiry_wheel: index items with an expiry time by\n"
+           "                it, and free them the second they expire.\n"
+           "              - hotcache: let each worker thread keep hold of the\n"
+           "                items it is asked for most, and serve GETs for them\n"
+           "                without locking.\n"
+           "              - epoch_reclaim: send items to GET clients without\n"
+           "                taking a reference on them, and only reuse freed\n"
+           "                memory once every worker thread is done with it.\n"
+           "              - evict_reserve: once memory is full, evict in a\n"
+           "                background thread to keep this many free chunks\n"
+           "                in each slab class, so sets don't have to evict\n"
+           "                (default 0, off)\n"
+           "              - native_counters: keep counters as 64-bit integers\n"
+           "                once they are incremented or decremented, so that\n"
+           "                incr and decr don't parse, format or allocate.\n"
+           "              - slab_chunk_max: size of the largest slab class, at\n"
+           "                least 512 bytes and at most a slab page (default\n"
+           "                half a page). Items above it are stored as chunks\n"
+           "                from the slab classes.\n"
            );
     return;
 }
@@ -4775,6 +5191,7 @@ int main (int argc, char **argv) {
     bool protocol_specified = false;
     bool tcp_specified = false;
     bool udp_specified = false;
+    enum hashfunc_type hash_type = JENKINS_HASH;
 
     char *subopts;
     char *subopts_value;
@@ -4782,13 +5199,45 @@ int main (int argc, char **argv) {
         MAXCONNS_FAST = 0,
         HASHPOWER_INIT,
         SLAB_REASSIGN,
-        SLAB_AUTOMOVE
+        SLAB_AUTOMOVE,
+        OPTIMISTIC_GET,
+        HASH_LAYOUT,
+        HASH_ALGORITHM,
+        HASH_SHRINK_PCT,
+        LRU_SEGMENTED,
+        HOT_LRU_PCT,
+        WARM_LRU_PCT,
+        LRU_MODE,
+        LRU_CRAWLER,
+        LRU_CRAWLER_SLEEP,
+        EXPIRY_WHEEL,
+        HOTCACHE,
+        EPOCH_RECLAIM,
+        EVICT_RESERVE,
+        NATIVE_COUNTERS,
+        SLAB_CHUNK_MAX
     };
     char *const subopts_tokens[] = {
         [MAXCONNS_FAST] = "maxconns_fast",
         [HASHPOWER_INIT] = "hashpower",
         [SLAB_REASSIGN] = "slab_reassign",
         [SLAB_AUTOMOVE] = "slab_automove",
+        [OPTIMISTIC_GET] = "optimistic_get",
+        [HASH_LAYOUT] = "hash_layout",
+        [HASH_ALGORITHM] = "hash_algorithm",
+        [HASH_SHRINK_PCT] = "hash_shrink_pct",
+        [LRU_SEGMENTED] = "lru_segmented",
+        [HOT_LRU_PCT] = "hot_lru_pct",
+        [WARM_LRU_PCT] = "warm_lru_pct",
+        [LRU_MODE] = "lru_mode",
+        [LRU_CRAWLER] = "lru_crawler",
+        [LRU_CRAWLER_SLEEP] = "lru_crawler_sleep",
+        [EXPIRY_WHEEL] = "expiry_wheel",
+        [HOTCACHE] = "hotcache",
+        [EPOCH_RECLAIM] = "epoch_reclaim",
+        [EVICT_RESERVE] = "evict_reserve",
+        [NATIVE_COUNTERS] = "native_counters",
+        [SLAB_CHUNK_MAX] = "slab_chunk_max",
         NULL
     };
 
@@ -5003,13 +5452,6 @@ int main (int argc, char **argv) {
                 fprintf(stderr, "Cannot set item size limit higher than 128 mb.\n");
                 return 1;
             }
-            if (settings.item_size_max > 1024 * 1024) {
-                fprintf(stderr, "WARNING: Setting item max size above 1MB is not"
-                    " recommended!\n"
-                    " Raising this limit increases the minimum memory requirements\n"
-                    " and will decrease your memory efficiency.\n"
-                );
-            }
             break;
         case 'S': /* set Sasl authentication to true. Default is false */
 #ifndef ENABLE_SASL
@@ -5058,6 +5500,137 @@ int main (int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case OPTIMISTIC_GET:
+                settings.optimistic_get = true;
+                break;
+            case HASH_LAYOUT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing argument for hash_layout\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "chained") == 0) {
+                    settings.hash_layout = HASH_LAYOUT_CHAINED;
+                } else if (strcmp(subopts_value, "bucketed") == 0) {
+                    settings.hash_layout = HASH_LAYOUT_BUCKETED;
+                } else {
+                    fprintf(stderr, "Invalid value for hash_layout: %s\n"
+                            " -- should be one of chained or bucketed\n",
+                            subopts_value);
+                    return 1;
+                }
+                break;
+            case HASH_ALGORITHM:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing argument for hash_algorithm\n");
+                    return 1;
+                }
+                if (!hash_type_from_name(subopts_value, &hash_type)) {
+                    fprintf(stderr, "Invalid value for hash_algorithm: %s\n"
+                            " -- should be one of jenkins, murmur3, crc32c"
+                            " or siphash\n", subopts_value);
+                    return 1;
+                }
+                break;
+            case HASH_SHRINK_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for hash_shrink_pct\n");
+                    return 1;
+                }
+                settings.hash_shrink_pct = atoi(subopts_value);
+                /* Past a quarter, a freshly halved table would be close to
+                 * growing straight back. */
+                if (settings.hash_shrink_pct < 0 || settings.hash_shrink_pct > 25) {
+                    fprintf(stderr, "hash_shrink_pct must be between 0 and 25\n");
+                    return 1;
+                }
+                break;
+            case LRU_SEGMENTED:
+                settings.lru_segmented = true;
+                break;
+            case HOT_LRU_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for hot_lru_pct\n");
+                    return 1;
+                }
+                settings.hot_lru_pct = atoi(subopts_value);
+                if (settings.hot_lru_pct < 1 || settings.hot_lru_pct > 80) {
+                    fprintf(stderr, "hot_lru_pct must be between 1 and 80\n");
+                    return 1;
+                }
+                break;
+            case WARM_LRU_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for warm_lru_pct\n");
+                    return 1;
+                }
+                settings.warm_lru_pct = atoi(subopts_value);
+                if (settings.warm_lru_pct < 1 || settings.warm_lru_pct > 80) {
+                    fprintf(stderr, "warm_lru_pct must be between 1 and 80\n");
+                    return 1;
+                }
+                break;
+            case LRU_MODE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing argument for lru_mode\n");
+                    return 1;
+                }
+                if (!lru_mode_from_name(subopts_value, &settings.lru_mode)) {
+                    fprintf(stderr, "Invalid value for lru_mode: %s\n"
+                            " -- should be one of lru, clock, lfu or tinylfu\n",
+                            subopts_value);
+                    return 1;
+                }
+                break;
+            case LRU_CRAWLER:
+                settings.lru_crawler = true;
+                break;
+            case LRU_CRAWLER_SLEEP:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for lru_crawler_sleep\n");
+                    return 1;
+                }
+                settings.lru_crawler_sleep = atoi(subopts_value);
+                if (settings.lru_crawler_sleep < 0 ||
+                    settings.lru_crawler_sleep > 1000000) {
+                    fprintf(stderr, "lru_crawler_sleep must be between 0 and 1000000\n");
+                    return 1;
+                }
+                break;
+            case EXPIRY_WHEEL:
+                settings.expiry_wheel = true;
+                break;
+            case HOTCACHE:
+                settings.hotcache = true;
+                break;
+            case EPOCH_RECLAIM:
+                settings.epoch_reclaim = true;
+                break;
+            case EVICT_RESERVE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for evict_reserve\n");
+                    return 1;
+                }
+                settings.evict_reserve = atoi(subopts_value);
+                if (settings.evict_reserve < 0 ||
+                    settings.evict_reserve > 1000000) {
+                    fprintf(stderr, "evict_reserve must be between 0 and 1000000\n");
+                    return 1;
+                }
+                break;
+            case NATIVE_COUNTERS:
+                settings.native_counters = true;
+                break;
+            case SLAB_CHUNK_MAX:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for slab_chunk_max\n");
+                    return 1;
+                }
+                settings.slab_chunk_max = atoi(subopts_value);
+                if (settings.slab_chunk_max < 512) {
+                    fprintf(stderr, "slab_chunk_max can't be less than 512 bytes\n");
+                    return 1;
+                }
+                break;
             default:
                 printf("Illegal suboption \"%s\"\n", subopts_value);
                 return 1;
@@ -5071,6 +5644,45 @@ int main (int argc, char **argv) {
         }
     }
 
+    if (settings.hot_lru_pct + settings.warm_lru_pct > 80) {
+        fprintf(stderr, "hot_lru_pct + warm_lru_pct can't be more than 80\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_segmented && settings.lru_mode == LRU_MODE_CLOCK) {
+        fprintf(stderr, "lru_segmented can't be used with lru_mode=clock\n");
+        exit(EX_USAGE);
+    }
+
+    if (!settings.lru_segmented && settings.lru_mode == LRU_MODE_TINYLFU) {
+        fprintf(stderr, "lru_mode=tinylfu needs lru_segmented\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.evict_reserve > 0 && settings.evict_to_free == 0) {
+        fprintf(stderr, "evict_reserve can't be used with -M\n");
+        exit(EX_USAGE);
+    }
+
+    /* Pages stay at 1MB however big items get; larger ones are chunked. */
+    settings.slab_page_size = settings.item_size_max < 1024 * 1024
+        ? settings.item_size_max : 1024 * 1024;
+    if (settings.slab_chunk_max == 0)
+        settings.slab_chunk_max = settings.slab_page_size / 2;
+    if (settings.slab_chunk_max > settings.slab_page_size) {
+        fprintf(stderr, "slab_chunk_max can't be more than the slab page size"
+                " (%d bytes)\n", settings.slab_page_size);
+        exit(EX_USAGE);
+    }
+    /* Chunks of the largest class must stay aligned within a page */
+    settings.slab_chunk_max -= settings.slab_chunk_max % CHUNK_ALIGN_BYTES;
+
+    if (hash_init(hash_type) != 0) {
+        fprintf(stderr, "Failed to initialize hash_algorithm %s\n",
+                hash_type_name(hash_type));
+        exit(EX_USAGE);
+    }
+
     /*
      * Use one workerthread to serve each UDP port if the user specified
      * multiple ports
@@ -5195,6 +5807,10 @@ int main (int argc, char **argv) {
     assoc_init(settings.hashpower_init);
     conn_init();
     slabs_init(settings.maxbytes, settings.factor, preallocate);
+    if (settings.lru_mode == LRU_MODE_LFU ||
+        settings.lru_mode == LRU_MODE_TINYLFU) {
+        item_sketch_init();
+    }
 
     /*
      * ignore SIGPIPE signals; we can use errno == EPIPE if we
@@ -5216,6 +5832,31 @@ int main (int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (settings.lru_segmented &&
+        start_lru_maintainer_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings.lru_crawler &&
+        start_lru_crawler_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings.expiry_wheel &&
+        start_expiry_wheel_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings.evict_reserve > 0 &&
+        start_evictor_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings.use_cas &&
+        start_prefix_sweep_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
     /* initialise clock event */
     clock_handler(0, 0, 0);
 
@@ -5296,6 +5937,16 @@ int main (int argc, char **argv) {
     }
 
     stop_assoc_maintenance_thread();
+    if (settings.lru_segmented)
+        stop_lru_maintainer_thread();
+    if (settings.lru_crawler)
+        stop_lru_crawler_thread();
+    if (settings.expiry_wheel)
+        stop_expiry_wheel_thread();
+    if (settings.evict_reserve > 0)
+        stop_evictor_thread();
+    if (settings.use_cas)
+        stop_prefix_sweep_thread();
 
     /* remove the PID file if we're a daemon */
     if (do_daemonize)
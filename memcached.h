@@ -17,6 +17,7 @@
 #include <netdb.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "protocol_binary.h"
 #include "cache.h"
@@ -26,6 +27,9 @@
 /** Maximum length of a key. */
 #define KEY_MAX_LENGTH 250
 
+/** Most keys looked up together by item_get_batch(). */
+#define ITEM_BATCH_MAX 32
+
 /** Size of an incr buf. */
 #define INCR_MAX_STORAGE_LEN 24
 
@@ -34,9 +38,10 @@
 #define UDP_MAX_PAYLOAD_SIZE 1400
 #define UDP_HEADER_SIZE 8
 #define MAX_SENDBUF_SIZE (256 * 1024 * 1024)
-/* I'm told the max length of a 64-bit num converted to string is 20 bytes.
- * Plus a few for spaces, \r\n, \0 */
-#define SUFFIX_SIZE 24
+/* Room for the " flags length cas\r\n" end of a VALUE line: two 32-bit and
+ * one 64-bit number, spaces, \r\n and \0, followed by the value of a
+ * native counter and its \r\n. */
+#define SUFFIX_SIZE 64
 
 /** Initial size of list of items being returned by "get". */
 #define ITEM_LIST_INITIAL 200
@@ -94,12 +99,17 @@
 #define ITEM_suffix(item) ((char*) &((item)->data) + (item)->nkey + 1 \
          + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
 
+#define FLAGS_SIZE(item) (((item)->it_flags & ITEM_CFLAGS) ? sizeof(uint32_t) : 0)
+
 #define ITEM_data(item) ((char*) &((item)->data) + (item)->nkey + 1 \
-         + (item)->nsuffix \
+         + FLAGS_SIZE(item) \
          + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
 
-#define ITEM_ntotal(item) (sizeof(struct _stritem) + (item)->nkey + 1 \
-         + (item)->nsuffix + (item)->nbytes \
+/* A chunked item's header always fills a slot of the largest slab class */
+#define ITEM_ntotal(item) (((item)->it_flags & ITEM_CHUNKED) \
+         ? (size_t)settings.slab_chunk_max \
+         : sizeof(struct _stritem) + (item)->nkey + 1 \
+         + FLAGS_SIZE(item) + (item)->nbytes \
          + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
 
 #define STAT_KEY_LEN 128
@@ -185,6 +195,18 @@ enum item_lock_types {
     ITEM_LOCK_GLOBAL
 };
 
+enum hash_layout {
+    HASH_LAYOUT_CHAINED = 0, /* array of item chains */
+    HASH_LAYOUT_BUCKETED     /* cache line buckets with hash tags */
+};
+
+enum lru_mode {
+    LRU_MODE_LIST = 0,  /* hits move the item to the head of its LRU */
+    LRU_MODE_CLOCK,     /* hits set an access bit; a clock hand evicts */
+    LRU_MODE_LFU,       /* evict the least asked for of the oldest items */
+    LRU_MODE_TINYLFU    /* new items must be asked for more than the victim */
+};
+
 #define IS_UDP(x) (x == udp_transport)
 
 #define NREAD_ADD 1
@@ -236,6 +258,9 @@ struct thread_stats {
     uint64_t          conn_yields; /* # of yields for connections (-R option)*/
     uint64_t          auth_cmds;
     uint64_t          auth_errors;
+    uint64_t          hotcache_hits;
+    uint64_t          hotcache_invalid;   /* entries found stale */
+    uint64_t          hotcache_evictions; /* entries dropped to make room or aged out */
     struct slab_stats slab_stats[MAX_NUMBER_OF_SLAB_CLASSES];
 };
 
@@ -267,6 +292,8 @@ struct stats {
     unsigned int  hash_power_level; /* Better hope it's not over 9000 */
     uint64_t      hash_bytes;       /* size used for hash tables */
     bool          hash_is_expanding; /* If the hash table is being expanded */
+    bool          hash_is_shrinking; /* If the hash table is being shrunk */
+    unsigned int  hash_buckets_moved; /* old buckets migrated by a resize */
     uint64_t      expired_unfetched; /* items reclaimed but never touched */
     uint64_t      evicted_unfetched; /* items evicted but never touched */
     bool          slab_reassign_running; /* slab reassign in progress */
@@ -301,13 +328,29 @@ struct settings {
     bool use_cas;
     enum protocol binding_protocol;
     int backlog;
-    int item_size_max;        /* Maximum item size, and upper end for slabs */
+    int item_size_max;        /* Maximum item size */
+    int slab_page_size;     /* Size of a slab page, at most 1MB */
+    int slab_chunk_max;     /* Largest slab chunk; bigger items are chunked */
     bool sasl;              /* SASL on/off */
     bool maxconns_fast;     /* Whether or not to early close connections */
     bool slab_reassign;     /* Whether or not slab reassignment is allowed */
     int slab_automove;     /* Whether or not to automatically move slabs */
     int hashpower_init;     /* Starting hash power level */
     bool shutdown_command; /* allow shutdown command */
+    bool optimistic_get;   /* look items up without the item lock on GET */
+    enum hash_layout hash_layout; /* how assoc.c lays out the hash table */
+    int hash_shrink_pct;   /* shrink the hash table when this % full, 0 = never */
+    bool lru_segmented;    /* hot/warm/cold LRU with a maintainer thread */
+    int hot_lru_pct;       /* share of a class's items kept in the hot LRU */
+    int warm_lru_pct;      /* share of a class's items kept in the warm LRU */
+    enum lru_mode lru_mode; /* how hits and evictions use the LRU */
+    bool lru_crawler;      /* reclaim expired items in a background thread */
+    int lru_crawler_sleep; /* usec the crawler sleeps between batches */
+    bool expiry_wheel;     /* free items as they expire, from a timer wheel */
+    bool hotcache;         /* per-thread cache of hot items for GET */
+    bool epoch_reclaim;    /* GET takes no references; frees wait for epochs */
+    int evict_reserve;     /* free chunks the evictor keeps per class, 0 = off */
+    bool native_counters;  /* incr/decr keep counters as binary integers */
 };
 
 extern struct stats stats;
@@ -322,21 +365,68 @@ extern struct settings settings;
 
 #define ITEM_FETCHED 8
 
+/* Fetched since the LRU maintainer last moved it (-o lru_segmented), or
+ * since the clock hand last passed it (-o lru_mode=clock) */
+#define ITEM_ACTIVE 16
+
+/* The LRU segment the item is queued in, an enum lru_segment. Changed only
+ * under both its item lock and the LRU lock of its class. */
+#define ITEM_LRU_SHIFT 5
+#define ITEM_LRU_MASK (3 << ITEM_LRU_SHIFT)
+
+/* The client flags are non-zero and stored after the key; zero flags take
+ * no space. */
+#define ITEM_CFLAGS 128
+
+/* Values too big for the largest slab class are stored in chunks from the
+ * regular classes. The item itself (ITEM_CHUNKED) holds the first part of
+ * the value, after a link to the first chunk. A chunk (ITEM_CHUNK) has no
+ * key; its next links to the following chunk, its prev to the item, and its
+ * exptime holds the hash of the item's key for the slab mover. */
+#define ITEM_CHUNKED 256
+#define ITEM_CHUNK 512
+
+/* Unlinked and unreferenced, waiting in limbo for the workers to pass the
+ * epoch it was retired in before its memory is reused (-o epoch_reclaim). */
+#define ITEM_RETIRED 1024
+
+/* A native counter (-o native_counters): the value is a uint64_t at the
+ * first 8-byte boundary in the data, updated atomically under the item lock
+ * and only turned into ASCII when it is sent. nbytes covers the padding. */
+#define ITEM_COUNTER 2048
+#define ITEM_COUNTER_BYTES (2 * sizeof(uint64_t))
+#define ITEM_counter(item) ((uint64_t *)(((uintptr_t)ITEM_data(item) + 7) \
+                                         & ~(uintptr_t)7))
+#define ITEM_lru(item) (((item)->it_flags & ITEM_LRU_MASK) >> ITEM_LRU_SHIFT)
+
+#ifdef COMPACT_ITEMS
+/* With --enable-compact-items, the LRU, hash chain and slab freelist links
+ * between items are 32-bit references into the slab arena: 1 + the item's
+ * offset in CHUNK_ALIGN_BYTES units, 0 for none. The arena is allocated in
+ * one piece, so memory is limited to 32GB. */
+typedef uint32_t item_ref_t;
+#else
+typedef struct _stritem *item_ref_t;
+#endif
+
 /**
  * Structure for storing items within memcached.
  */
 typedef struct _stritem {
-    struct _stritem *next;
-    struct _stritem *prev;
-    struct _stritem *h_next;    /* hash chain next */
+    item_ref_t      next;
+    item_ref_t      prev;
+    item_ref_t      h_next;     /* hash chain next */
     rel_time_t      time;       /* least recent access */
     rel_time_t      exptime;    /* expire time */
     int             nbytes;     /* size of data */
     unsigned short  refcount;
-    uint8_t         nsuffix;    /* length of flags-and-length string */
-    uint8_t         it_flags;   /* ITEM_* above */
+    uint16_t        it_flags;   /* ITEM_* above */
     uint8_t         slabs_clsid;/* which slab class we're in */
     uint8_t         nkey;       /* key length, w/terminating null and padding */
+    uint16_t        flush_gen;  /* flush generation it was linked in */
+#ifndef COMPACT_ITEMS
+    uint32_t        hv;         /* hash(key), set when the item is allocated */
+#endif
     /* this odd type prevents type-punning issues when we do
      * the little shuffle to save space when not using CAS. */
     union {
@@ -345,10 +435,44 @@ typedef struct _stritem {
     } data[];
     /* if it_flags & ITEM_CAS we have 8 bytes CAS */
     /* then null-terminated key */
-    /* then " flags length\r\n" (no terminating null) */
+    /* then if it_flags & ITEM_CFLAGS 4 bytes of client flags, unaligned */
     /* then data with terminating \r\n (no terminating null; it's binary!) */
 } item;
 
+/* Follow and set the links between items. Compact items also don't keep
+ * the key's hash, it is worked out again when needed. */
+#ifdef COMPACT_ITEMS
+extern char *item_arena;
+/* Functions, not macros: lock-free readers must load a link only once. */
+static inline item *ITEM_ptr(const item_ref_t ref) {
+    return ref ? (item *)(item_arena + ((size_t)ref - 1) * CHUNK_ALIGN_BYTES)
+               : NULL;
+}
+static inline item_ref_t ITEM_ref(const item *it) {
+    return it ? (item_ref_t)(((const char *)it - item_arena)
+                             / CHUNK_ALIGN_BYTES + 1) : 0;
+}
+#define ITEM_hv(it) hash(ITEM_key(it), (it)->nkey, 0)
+#else
+#define ITEM_ptr(ref) (ref)
+#define ITEM_ref(it) (it)
+#define ITEM_hv(it) ((it)->hv)
+#endif
+/* The client flags; stored unaligned, so they're copied out. */
+static inline uint32_t ITEM_get_flags(item *it) {
+    uint32_t flags = 0;
+    if (it->it_flags & ITEM_CFLAGS)
+        memcpy(&flags, ITEM_suffix(it), sizeof(flags));
+    return flags;
+}
+
+#define ITEM_next(it) ITEM_ptr((it)->next)
+#define ITEM_prev(it) ITEM_ptr((it)->prev)
+#define ITEM_h_next(it) ITEM_ptr((it)->h_next)
+#define ITEM_set_next(it, n) ((it)->next = ITEM_ref(n))
+#define ITEM_set_prev(it, p) ((it)->prev = ITEM_ref(p))
+#define ITEM_set_h_next(it, n) ((it)->h_next = ITEM_ref(n))
+
 typedef struct {
     pthread_t thread_id;        /* unique ID of this thread */
     struct event_base *base;    /* libevent handle this thread uses */
@@ -359,6 +483,9 @@ typedef struct {
     struct conn_queue *new_conn_queue; /* queue of new connections to handle */
     cache_t *suffix_cache;      /* suffix cache */
     uint8_t item_lock_type;     /* use fine-grained or global item lock */
+    struct hotcache *hotcache;  /* hot items, with -o hotcache */
+    volatile uint32_t epoch;    /* epoch entered, 0 when holding no items */
+    unsigned int epoch_holders; /* connections holding items in the epoch */
 } LIBEVENT_THREAD;
 
 typedef struct {
@@ -394,6 +521,8 @@ struct conn {
 
     char   *ritem;  /** when we read in an item's value, it goes here */
     int    rlbytes;
+    void   *rseg;   /** segment of a chunked value ritem points into */
+    int    rvleft;  /** bytes of the value left after this segment */
 
     /* data for the nread state */
 
@@ -423,6 +552,7 @@ struct conn {
     int    isize;
     item   **icurr;
     int    ileft;
+    bool   epoch_held; /* ilist holds no references, see epoch_enter() */
 
     char   **suffixlist;
     int    suffixsize;
@@ -454,6 +584,7 @@ struct conn {
     short cmd; /* current command being processed */
     int opaque;
     int keylen;
+    int bin_prefetched; /* quiet gets ahead of this one already prefetched */
     conn   *next;     /* Used for generating a list of conn structures */
     LIBEVENT_THREAD *thread; /* Pointer to the thread object serving this connection */
 };
@@ -527,8 +658,22 @@ bool  conn_add_to_freelist(conn *c);
 int   is_listen_thread(void);
 item *item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbytes);
 char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
-void  item_flush_expired(void);
+char *item_keys(uint32_t *cursor, const unsigned int count, unsigned int *bytes);
+void  item_flush(const rel_time_t when);
+bool  item_flush_prefix(const char *prefix, size_t nprefix);
+void  item_flush_tick(void);
 item *item_get(const char *key, const size_t nkey);
+void  item_get_batch(LIBEVENT_THREAD *t, char **keys, const size_t *nkeys,
+                     item **items, const int count);
+void  item_release(LIBEVENT_THREAD *t, item *it);
+void  epoch_enter(LIBEVENT_THREAD *t);
+void  epoch_exit(LIBEVENT_THREAD *t);
+uint32_t epoch_advance(void);
+uint32_t epoch_oldest(void);
+/* Whether epoch a came before epoch b; the counter wraps around. */
+#define EPOCH_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+void  item_prefetch_batch(char **keys, const size_t *nkeys, uint32_t *hvs,
+                          const int count);
 item *item_touch(const char *key, const size_t nkey, uint32_t exptime);
 int   item_link(item *it);
 void  item_remove(item *it);
@@ -545,9 +690,20 @@ void item_lock(uint32_t hv);
 void *item_trylock(uint32_t hv);
 void item_trylock_unlock(void *arg);
 void item_unlock(uint32_t hv);
+void item_lock_bucket(uint32_t bucket, unsigned int power);
+void item_unlock_bucket(uint32_t bucket, unsigned int power);
+void item_lock_all(void);
+void item_unlock_all(void);
 void switch_item_lock_type(enum item_lock_types type);
 unsigned short refcount_incr(unsigned short *refcount);
 unsigned short refcount_decr(unsigned short *refcount);
+bool refcount_incr_nonzero(unsigned short *refcount);
+void item_flags_set(item *it, const uint16_t flags);
+void item_flags_clear(item *it, const uint16_t flags);
+uint64_t item_counter_get(item *it);
+void item_counter_set(item *it, const uint64_t value);
+void item_lock_seq_bump(uint32_t hv);
+unsigned int item_lock_seq(uint32_t hv);
 void STATS_LOCK(void);
 void STATS_UNLOCK(void);
 void threadlocal_stats_reset(void);
@@ -573,3 +729,10 @@ extern void drop_privileges(void);
 
 #define likely(x)       __builtin_expect((x),1)
 #define unlikely(x)     __builtin_expect((x),0)
+
+/* Hint that addr will be read soon, so the CPU can start fetching it. */
+#if defined(__GNUC__)
+#define prefetch(addr)  __builtin_prefetch((addr))
+#else
+#define prefetch(addr)  ((void)(addr))
+#endif
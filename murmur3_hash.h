@@ -0,0 +1,14 @@
+#ifndef MURMUR3_HASH_H
+#define    MURMUR3_HASH_H
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+uint32_t murmur3_hash(const void *key, size_t length, const uint32_t initval);
+
+#ifdef    __cplusplus
+}
+#endif
+
+#endif    /* MURMUR3_HASH_H */
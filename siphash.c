@@ -0,0 +1,104 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * SipHash-2-4 by Jean-Philippe Aumasson and Daniel J. Bernstein:
+ *    <https://131002.net/siphash/>
+ *
+ * This is the keyed hash mode. The key is drawn at random when the server
+ * starts, so clients can't precompute keys that all land in one chain.
+ * Seeding jenkins or murmur3 doesn't give that: both have collisions that
+ * hold for every seed.
+ */
+#include "memcached.h"
+#include "siphash.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+
+static uint8_t sip_key[16];
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                    \
+    do {                                                            \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                    \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                    \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+    } while (0)
+
+static inline uint64_t u8to64_le(const uint8_t *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) |
+        ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+        ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+        ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+uint64_t siphash24(const uint8_t key[16], const void *data, size_t length) {
+    const uint8_t *in = data;
+    const uint8_t *end = in + length - (length % 8);
+    uint64_t k0 = u8to64_le(key);
+    uint64_t k1 = u8to64_le(key + 8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+    uint64_t b = ((uint64_t)length) << 56;
+    uint64_t m;
+
+    for (; in != end; in += 8) {
+        m = u8to64_le(in);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    switch (length & 7) {
+        case 7: b |= ((uint64_t)in[6]) << 48;
+        case 6: b |= ((uint64_t)in[5]) << 40;
+        case 5: b |= ((uint64_t)in[4]) << 32;
+        case 4: b |= ((uint64_t)in[3]) << 24;
+        case 3: b |= ((uint64_t)in[2]) << 16;
+        case 2: b |= ((uint64_t)in[1]) << 8;
+        case 1: b |= ((uint64_t)in[0]);
+        case 0: break;
+    }
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* Draws a fresh key. Returns -1 if no good randomness is available, as a
+ * guessable key would defeat the point. */
+int siphash_init(void) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    ssize_t got;
+
+    if (fd < 0) {
+        perror("Failed to open /dev/urandom for the siphash key");
+        return -1;
+    }
+    got = read(fd, sip_key, sizeof(sip_key));
+    close(fd);
+    if (got != sizeof(sip_key)) {
+        fprintf(stderr, "Failed to read the siphash key from /dev/urandom\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* initval is folded into the result; the secret key is what seeds it. */
+uint32_t siphash_hash(const void *key, size_t length, const uint32_t initval) {
+    uint64_t h = siphash24(sip_key, key, length);
+    return (uint32_t)(h ^ (h >> 32)) ^ initval;
+}
@@ -0,0 +1,16 @@
+#ifndef SIPHASH_H
+#define    SIPHASH_H
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+int siphash_init(void);
+uint64_t siphash24(const uint8_t key[16], const void *data, size_t length);
+uint32_t siphash_hash(const void *key, size_t length, const uint32_t initval);
+
+#ifdef    __cplusplus
+}
+#endif
+
+#endif    /* SIPHASH_H */
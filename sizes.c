@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stddef.h>
 
 #include "memcached.h"
 
@@ -16,6 +17,18 @@ int main(int argc, char **argv) {
     display("Settings", sizeof(struct settings));
     display("Item (no cas)", sizeof(item));
     display("Item (cas)", sizeof(item) + sizeof(uint64_t));
+    display("Item link", sizeof(item_ref_t));
+#ifdef COMPACT_ITEMS
+    /* Compact items work the key hash out again instead of caching it. */
+    display("Item header slack",
+            sizeof(item) - (offsetof(item, flush_gen) + sizeof(uint16_t)));
+#else
+    /* The cached key hash fills alignment padding at the end of the header,
+     * so it doesn't grow the item. Slack is the padding still left over. */
+    display("Item cached hash", sizeof(((item *)0)->hv));
+    display("Item header slack",
+            sizeof(item) - (offsetof(item, hv) + sizeof(((item *)0)->hv)));
+#endif
     display("Libevent thread",
             sizeof(LIBEVENT_THREAD) - sizeof(struct thread_stats));
     display("Connection", sizeof(conn));
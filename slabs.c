@@ -18,8 +18,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sysexits.h>
 
 /* powers-of-N allocation structures */
 
@@ -48,6 +50,13 @@ static void *mem_base = NULL;
 static void *mem_current = NULL;
 static size_t mem_avail = 0;
 
+#ifdef COMPACT_ITEMS
+/* Compact items link to each other by offset from here; it's mem_base. */
+char *item_arena = NULL;
+/* The most memory a 32-bit item reference can reach. */
+#define ITEM_ARENA_MAX ((size_t)UINT32_MAX * CHUNK_ALIGN_BYTES)
+#endif
+
 /**
  * Access to the slab allocator is protected by this lock
  */
@@ -88,6 +97,13 @@ unsigned int slabs_clsid(const size_t size) {
     return res;
 }
 
+/* Size of the chunks of class id. Fixed once slabs_init() is done. */
+unsigned int slabs_chunk_size(const unsigned int id) {
+    if (id < POWER_SMALLEST || id > power_largest)
+        return 0;
+    return slabclass[id].size;
+}
+
 /**
  * Determines the chunk sizes and initializes the slab class descriptors
  * accordingly.
@@ -98,6 +114,7 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
 
     mem_limit = limit;
 
+#ifndef COMPACT_ITEMS
     if (prealloc) {
         /* Allocate everything in a big chunk with malloc */
         mem_base = malloc(mem_limit);
@@ -109,16 +126,17 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
                     " one large chunk.\nWill allocate in smaller chunks\n");
         }
     }
+#endif
 
     memset(slabclass, 0, sizeof(slabclass));
 
-    while (++i < POWER_LARGEST && size <= settings.item_size_max / factor) {
+    while (++i < POWER_LARGEST && size <= settings.slab_chunk_max / factor) {
         /* Make sure items are always n-byte aligned */
         if (size % CHUNK_ALIGN_BYTES)
             size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
 
         slabclass[i].size = size;
-        slabclass[i].perslab = settings.item_size_max / slabclass[i].size;
+        slabclass[i].perslab = settings.slab_page_size / slabclass[i].size;
         size *= factor;
         if (settings.verbose > 1) {
             fprintf(stderr, "slab class %3d: chunk size %9u perslab %7u\n",
@@ -127,13 +145,37 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
     }
 
     power_largest = i;
-    slabclass[power_largest].size = settings.item_size_max;
-    slabclass[power_largest].perslab = 1;
+    slabclass[power_largest].size = settings.slab_chunk_max;
+    slabclass[power_largest].perslab =
+        settings.slab_page_size / settings.slab_chunk_max;
     if (settings.verbose > 1) {
         fprintf(stderr, "slab class %3d: chunk size %9u perslab %7u\n",
                 i, slabclass[i].size, slabclass[i].perslab);
     }
 
+#ifdef COMPACT_ITEMS
+    /* Items have to live in one arena, so it's always allocated up front;
+     * pages are only touched once they're used, unless prealloc is set.
+     * Every class may take its first page over the limit, so there is
+     * room for that too. */
+    {
+        size_t arena = mem_limit + (size_t)power_largest * settings.slab_page_size;
+        if (mem_limit == 0 || arena > ITEM_ARENA_MAX) {
+            fprintf(stderr, "Compact items need a memory limit of less than "
+                    "%lu megabytes.\n", (unsigned long)(ITEM_ARENA_MAX >> 20));
+            exit(EX_USAGE);
+        }
+        if ((mem_base = malloc(arena)) == NULL) {
+            fprintf(stderr, "Failed to allocate the %lu megabyte item "
+                    "arena.\n", (unsigned long)(arena >> 20));
+            exit(EX_OSERR);
+        }
+        item_arena = mem_base;
+        mem_current = mem_base;
+        mem_avail = arena;
+    }
+#endif
+
     /* for the test suite:  faking of how much we've already malloc'd */
     {
         char *t_initial_malloc = getenv("T_MEMD_INITIAL_MALLOC");
@@ -194,7 +236,7 @@ static void split_slab_page_into_freelist(char *ptr, const unsigned int id) {
 
 static int do_slabs_newslab(const unsigned int id) {
     slabclass_t *p = &slabclass[id];
-    int len = settings.slab_reassign ? settings.item_size_max
+    int len = settings.slab_reassign ? settings.slab_page_size
         : p->size * p->perslab;
     char *ptr;
 
@@ -238,8 +280,8 @@ static void *do_slabs_alloc(const size_t size, unsigned int id) {
     } else if (p->sl_curr != 0) {
         /* return off our freelist */
         it = (item *)p->slots;
-        p->slots = it->next;
-        if (it->next) it->next->prev = 0;
+        p->slots = ITEM_next(it);
+        if (it->next) ITEM_next(it)->prev = 0;
         p->sl_curr--;
         ret = (void *)it;
     }
@@ -269,8 +311,8 @@ static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
     it = (item *)ptr;
     it->it_flags |= ITEM_SLABBED;
     it->prev = 0;
-    it->next = p->slots;
-    if (it->next) it->next->prev = it;
+    ITEM_set_next(it, (item *)p->slots);
+    if (it->next) ITEM_set_prev(ITEM_next(it), it);
     p->slots = it;
 
     p->sl_curr++;
@@ -365,6 +407,8 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
 
     APPEND_STAT("active_slabs", "%d", total);
     APPEND_STAT("total_malloced", "%llu", (unsigned long long)mem_malloced);
+    APPEND_STAT("item_header_size", "%u", (unsigned int)(sizeof(item) +
+                (settings.use_cas ? sizeof(uint64_t) : 0)));
     add_stats(NULL, 0, NULL, 0, c);
 }
 
@@ -418,6 +462,37 @@ void slabs_stats(ADD_STAT add_stats, void *c) {
     pthread_mutex_unlock(&slabs_lock);
 }
 
+unsigned int slabs_free_chunks(const unsigned int id) {
+    slabclass_t *p;
+    unsigned int avail;
+    int len;
+
+    if (id < POWER_SMALLEST || id > power_largest)
+        return 0;
+    pthread_mutex_lock(&slabs_lock);
+    p = &slabclass[id];
+    len = settings.slab_reassign ? settings.slab_page_size
+        : p->size * p->perslab;
+    /* Same test as do_slabs_newslab() */
+    if (mem_limit == 0 || mem_malloced + len <= mem_limit || p->slabs == 0)
+        avail = UINT_MAX;
+    else
+        avail = p->sl_curr;
+    pthread_mutex_unlock(&slabs_lock);
+    return avail;
+}
+
+unsigned int slabs_chunks(const unsigned int id) {
+    unsigned int chunks;
+
+    if (id < POWER_SMALLEST || id > power_largest)
+        return 0;
+    pthread_mutex_lock(&slabs_lock);
+    chunks = slabclass[id].slabs * slabclass[id].perslab;
+    pthread_mutex_unlock(&slabs_lock);
+    return chunks;
+}
+
 void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal)
 {
     pthread_mutex_lock(&slabs_lock);
@@ -432,7 +507,6 @@ void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal)
     pthread_mutex_unlock(&slabs_lock);
 }
 
-static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t slab_rebalance_cond = PTHREAD_COND_INITIALIZER;
 static volatile int do_run_slab_thread = 1;
 static volatile int do_run_slab_rebalance_thread = 1;
@@ -444,7 +518,6 @@ static int slab_rebalance_start(void) {
     slabclass_t *s_cls;
     int no_go = 0;
 
-    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
 
     if (slab_rebal.s_clsid < POWER_SMALLEST ||
@@ -465,7 +538,6 @@ static int slab_rebalance_start(void) {
 
     if (no_go != 0) {
         pthread_mutex_unlock(&slabs_lock);
-        pthread_mutex_unlock(&cache_lock);
         return no_go; /* Should use a wrapper function... */
     }
 
@@ -485,7 +557,6 @@ static int slab_rebalance_start(void) {
     }
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     STATS_LOCK();
     stats.slab_reassign_running = true;
@@ -498,10 +569,14 @@ enum move_status {
     MOVE_PASS=0, MOVE_DONE, MOVE_BUSY, MOVE_LOCKED
 };
 
-/* refcount == 0 is safe since nobody can incr while cache_lock is held.
+/* refcount == 0 is safe since nobody can incr while the item lock is held.
  * refcount != 0 is impossible since flags/etc can be modified in other
  * threads. instead, note we found a busy one and bail. logic in do_item_get
  * will prevent busy items from continuing to be busy
+ *
+ * Free chunks are checked without taking a reference, and our reference on a
+ * linked item is dropped rather than reset, as optimistic readers (see
+ * item_get_optimistic) may grab one without the item lock.
  */
 static int slab_rebalance_move(void) {
     slabclass_t *s_cls;
@@ -510,7 +585,6 @@ static int slab_rebalance_move(void) {
     int refcount = 0;
     enum move_status status = MOVE_PASS;
 
-    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
 
     s_cls = &slabclass[slab_rebal.s_clsid];
@@ -520,28 +594,69 @@ static int slab_rebalance_move(void) {
         status = MOVE_PASS;
         if (it->slabs_clsid != 255) {
             void *hold_lock = NULL;
-            uint32_t hv = hash(ITEM_key(it), it->nkey, 0);
+            /* A chunk is locked by its item's key */
+            uint32_t hv = (it->it_flags & ITEM_CHUNK) ? it->exptime
+                                                       : ITEM_hv(it);
             if ((hold_lock = item_trylock(hv)) == NULL) {
                 status = MOVE_LOCKED;
             } else {
-                refcount = refcount_incr(&it->refcount);
-                if (refcount == 1) { /* item is unlinked, unused */
-                    if (it->it_flags & ITEM_SLABBED) {
-                        /* remove from slab freelist */
-                        if (s_cls->slots == it) {
-                            s_cls->slots = it->next;
-                        }
-                        if (it->next) it->next->prev = it->prev;
-                        if (it->prev) it->prev->next = it->next;
-                        s_cls->sl_curr--;
-                        status = MOVE_DONE;
+                if ((it->it_flags & ITEM_SLABBED) && it->refcount == 0) {
+                    /* free chunk; nobody can take a reference on it */
+                    if (s_cls->slots == it) {
+                        s_cls->slots = ITEM_next(it);
+                    }
+                    if (it->next) ITEM_next(it)->prev = it->prev;
+                    if (it->prev) ITEM_prev(it)->next = it->next;
+                    s_cls->sl_curr--;
+                    status = MOVE_DONE;
+                } else if ((it->it_flags & ITEM_RETIRED) != 0) {
+                    /* waiting for the epochs readers fetched it in; comes
+                     * back through the freelist */
+                    status = MOVE_LOCKED;
+                } else if ((it->it_flags & ITEM_CHUNK) != 0) {
+                    /* Part of a large item: throw out the whole item. The
+                     * chunk comes back through the freelist. */
+                    item *head = ITEM_prev(it);
+                    if (refcount_incr(&head->refcount) == 2 &&
+                        (head->it_flags & ITEM_LINKED) != 0) {
+                        pthread_mutex_unlock(&slabs_lock);
+                        do_item_unlink(head, hv);
+                        if (refcount_decr(&head->refcount) == 0)
+                            item_free(head);
+                        pthread_mutex_lock(&slabs_lock);
                     } else {
-                        status = MOVE_BUSY;
+                        refcount_decr(&head->refcount);
                     }
+                    status = MOVE_LOCKED;
+                } else if ((refcount = refcount_incr(&it->refcount)) == 1) {
+                    /* unlinked and being uploaded to */
+                    status = MOVE_BUSY;
                 } else if (refcount == 2) { /* item is linked but not busy */
                     if ((it->it_flags & ITEM_LINKED) != 0) {
-                        do_item_unlink_nolock(it, hash(ITEM_key(it), it->nkey, 0));
-                        status = MOVE_DONE;
+                        /* Unlinking takes the LRU lock, which comes before
+                         * slabs_lock. Our reference and the item lock keep
+                         * the chunk ours meanwhile. */
+                        pthread_mutex_unlock(&slabs_lock);
+                        do_item_unlink(it, hv);
+                        if (settings.epoch_reclaim) {
+                            /* A GET may be sending it without a reference:
+                             * retire it and pick it up once it's freed. */
+                            do_item_remove(it);
+                            status = MOVE_LOCKED;
+                        } else if (refcount_decr(&it->refcount) == 0) {
+                            status = MOVE_DONE;
+                            /* Its chunks may be in this page too, so go
+                             * over it again once they're back. */
+                            if ((it->it_flags & ITEM_CHUNKED) != 0) {
+                                item_free_chunks(it);
+                                slab_rebal.busy_items++;
+                            }
+                        } else {
+                            /* A reader got in; it frees the item once done
+                             * and we pick it up from the freelist later. */
+                            status = MOVE_LOCKED;
+                        }
+                        pthread_mutex_lock(&slabs_lock);
                     } else {
                         /* refcount == 1 + !ITEM_LINKED means the item is being
                          * uploaded to, or was just unlinked but hasn't been freed
@@ -561,7 +676,6 @@ static int slab_rebalance_move(void) {
 
         switch (status) {
             case MOVE_DONE:
-                it->refcount = 0;
                 it->it_flags = 0;
                 it->slabs_clsid = 255;
                 break;
@@ -591,7 +705,6 @@ static int slab_rebalance_move(void) {
     }
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     return was_busy;
 }
@@ -600,7 +713,6 @@ static void slab_rebalance_finish(void) {
     slabclass_t *s_cls;
     slabclass_t *d_cls;
 
-    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
 
     s_cls = &slabclass[slab_rebal.s_clsid];
@@ -612,7 +724,7 @@ static void slab_rebalance_finish(void) {
     s_cls->slabs--;
     s_cls->killing = 0;
 
-    memset(slab_rebal.slab_start, 0, (size_t)settings.item_size_max);
+    memset(slab_rebal.slab_start, 0, (size_t)settings.slab_page_size);
 
     d_cls->slab_list[d_cls->slabs++] = slab_rebal.slab_start;
     split_slab_page_into_freelist(slab_rebal.slab_start,
@@ -628,7 +740,6 @@ static void slab_rebalance_finish(void) {
     slab_rebalance_signal = 0;
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     STATS_LOCK();
     stats.slab_reassign_running = false;
@@ -667,11 +778,11 @@ static int slab_automove_decision(int *src, int *dst) {
     }
 
     item_stats_evictions(evicted_new);
-    pthread_mutex_lock(&cache_lock);
+    pthread_mutex_lock(&slabs_lock);
     for (i = POWER_SMALLEST; i < power_largest; i++) {
         total_pages[i] = slabclass[i].slabs;
     }
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&slabs_lock);
 
     /* Find a candidate source; something with zero evicts 3+ times */
     for (i = POWER_SMALLEST; i < power_largest; i++) {
@@ -757,6 +868,8 @@ static void *slab_rebalance_thread(void *arg) {
             /* Stuck waiting for some items to unlock, so slow down a bit
              * to give them a chance to free up */
             usleep(50);
+            if (settings.epoch_reclaim)
+                item_reclaim();
         }
 
         if (slab_rebalance_signal == 0) {
@@ -870,11 +983,11 @@ int start_slab_maintenance_thread(void) {
 }
 
 void stop_slab_maintenance_thread(void) {
-    mutex_lock(&cache_lock);
+    mutex_lock(&slabs_rebalance_lock);
     do_run_slab_thread = 0;
     do_run_slab_rebalance_thread = 0;
-    pthread_cond_signal(&maintenance_cond);
-    pthread_mutex_unlock(&cache_lock);
+    pthread_cond_signal(&slab_rebalance_cond);
+    pthread_mutex_unlock(&slabs_rebalance_lock);
 
     /* Wait for the maintenance thread to stop */
     pthread_join(maintenance_tid, NULL);
@@ -18,12 +18,22 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc);
 
 unsigned int slabs_clsid(const size_t size);
 
+/** Size of the chunks of a slab class, 0 if there's no such class */
+unsigned int slabs_chunk_size(const unsigned int id);
+
 /** Allocate object of given length. 0 on error */ /*@null@*/
 void *slabs_alloc(const size_t size, unsigned int id);
 
 /** Free previously allocated object */
 void slabs_free(void *ptr, size_t size, unsigned int id);
 
+/** Number of free chunks class id has, or UINT_MAX if it can still get
+    a new page */
+unsigned int slabs_free_chunks(const unsigned int id);
+
+/** Number of chunks class id has, used or free */
+unsigned int slabs_chunks(const unsigned int id);
+
 /** Adjust the stats for memory requested */
 void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal);
 
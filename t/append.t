@@ -0,0 +1,77 @@
+#!/usr/bin/perl
+# Appends and prepends that fit in the item's chunk are done in place; the
+# rest copy into a bigger item. Either way the value and CAS come out right.
+
+use strict;
+use warnings;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# The slab classes holding items, as a list of ids.
+sub item_classes {
+    my $sock = shift;
+    my $items = mem_stats($sock, "items");
+    return sort { $a <=> $b } map { /^items:(\d+):number$/ ? $1 : () }
+        keys %$items;
+}
+
+sub gets_cas {
+    my ($sock, $key) = @_;
+    print $sock "gets $key\r\n";
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE \S+ \d+ (\d+) (\d+)/;
+    my ($len, $cas) = ($1, $2);
+    my $data;
+    read($sock, $data, $len + 2);
+    is(scalar <$sock>, "END\r\n", "end of gets $key");
+    return $cas;
+}
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+print $sock "set foo 0 0 2\r\nhi\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+my @classes = item_classes($sock);
+my $cas = gets_cas($sock, "foo");
+
+print $sock "append foo 0 0 6\r\n there\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended to foo");
+print $sock "prepend foo 0 0 2\r\n<<\r\n";
+is(scalar <$sock>, "STORED\r\n", "prepended to foo");
+mem_get_is($sock, "foo", "<<hi there");
+is_deeply([item_classes($sock)], \@classes, "foo stayed in its chunk");
+my $new_cas = gets_cas($sock, "foo");
+isnt($new_cas, $cas, "CAS changed");
+
+print $sock "cas foo 0 0 1 $cas\r\n!\r\n";
+is(scalar <$sock>, "EXISTS\r\n", "the old CAS no longer works");
+print $sock "append foo 0 0 1\r\n!\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended again");
+mem_get_is($sock, "foo", "<<hi there!");
+
+# Too big for the chunk: copied to a bigger item, in the class above the
+# one it fits, which the next append then fits into.
+my $big = "x" x 200;
+print $sock "append foo 0 0 200\r\n$big\r\n";
+is(scalar <$sock>, "STORED\r\n", "big append");
+@classes = item_classes($sock);
+is(scalar @classes, 1, "foo is in one class");
+print $sock "append foo 0 0 3\r\nend\r\n";
+is(scalar <$sock>, "STORED\r\n", "small append after growing");
+mem_get_is($sock, "foo", "<<hi there!${big}end");
+is_deeply([item_classes($sock)], \@classes, "grown item had room for it");
+
+# Log-style appends, across many classes.
+my $log = "";
+my $ok = 0;
+for my $i (1 .. 300) {
+    my $line = "line $i;";
+    $log .= $line;
+    print $sock "append foo 0 0 " . length($line) . "\r\n$line\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+is($ok, 300, "appended 300 lines");
+mem_get_is($sock, "foo", "<<hi there!${big}end$log");
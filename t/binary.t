@@ -2,7 +2,7 @@
 
 use strict;
 use warnings;
-use Test::More tests => 3549;
+use Test::More tests => 3915;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -173,6 +173,21 @@ $empty->('y');
     is(keys(%$rv), 2, "Got only two answers like we expect");
 }
 
+{
+    # diag "MultiGet larger than one lookup batch";
+    my @keys = map { "mg$_" } (1 .. 100);
+    for (my $i = 0; $i < @keys; $i += 2) {
+        $mc->set($keys[$i], "val$i", $i, 0);
+    }
+    my $rv = $mc->get_multi(@keys);
+    is(keys(%$rv), 50, "Got the 50 keys that are set");
+    my $bad = grep {
+        my $i = substr($_, 2) - 1;
+        $i % 2 || !$rv->{$_} || $rv->{$_}->[0] != $i || $rv->{$_}->[1] ne "val$i"
+    } keys %$rv;
+    is($bad, 0, "Every hit has the right value and flags");
+}
+
 # diag "Test increment";
 $mc->flush;
 is($mc->incr("x"), 0, "First incr call is zero");
@@ -416,6 +431,28 @@ $mc->silent_mutation(::CMD_ADDQ, 'silentadd', 'silentaddval');
     is('yes', $stats{'cas_enabled'});
 }
 
+# diag "Native counters";
+{
+    my $s2 = new_memcached('-o native_counters');
+    my $mc2 = MC::Client->new($s2);
+    is($mc2->incr("n", 1, 41), 41, "Native counter created");
+    is($mc2->incr("n"), 42, "Native incr");
+    my ($flags, $val, $gcas) = $mc2->get("n");
+    is($val, "42", "Native counter read as ASCII");
+    my ($irv, $icas) = $mc2->incr_cas("n", 2**33);
+    is($irv, 8589934634, "Native incr past 32 bits");
+    ok($icas != $gcas, "Native incr changed the CAS");
+    is($mc2->decr("n", 2**40), 0, "Native decr floors at zero");
+    ($flags, $val) = $mc2->gat("n", 0);
+    is($val, "0", "GAT of a native counter");
+
+    $mc2->set("m", "100", 0, 0);
+    is($mc2->incr("m", 5), 105, "ASCII counter made native");
+    $mc2->_append_prepend(::CMD_APPEND, "m", "x");
+    ($flags, $val) = $mc2->get("m");
+    is($val, "105x", "Append to a native counter");
+}
+
 # diag "Test quit commands.";
 {
     my $s2 = new_memcached();
@@ -711,12 +748,19 @@ sub get_multi {
     my $self = shift;
     my @keys = @_;
 
+    # Send the whole run in one write, as real clients do.
+    my $msg = '';
     for (my $i = 0; $i < @keys; $i++) {
-        $self->send_command(::CMD_GETQ, $keys[$i], '', $i, '', 0);
+        $msg .= $self->build_command(::CMD_GETQ, $keys[$i], '', $i, '', 0);
     }
 
     my $terminal = @keys + 10;
-    $self->send_command(::CMD_NOOP, '', '', $terminal);
+    $msg .= $self->build_command(::CMD_NOOP, '', '', $terminal);
+
+    my $sent = $self->{socket}->send($msg);
+    die("Send failed:  $!") unless $sent;
+    die("only sent $sent of " . length($msg) . " bytes")
+        if $sent != length($msg);
 
     my %return;
     while (1) {
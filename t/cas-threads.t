@@ -0,0 +1,92 @@
+#!/usr/bin/perl
+# Increment one counter with gets/cas from several connections while others
+# keep the worker threads busy handing out CAS ids. Every increment has to
+# survive: two clients winning the same round would lose one.
+
+use strict;
+use warnings;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+use POSIX qw(_exit);
+
+my $server = new_memcached('-t 4');
+my $sock = $server->sock;
+
+my $incrementers = 4;
+my $increments = 300;
+my $keys = 100;
+
+print $sock "set counter 0 0 1\r\n0\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored counter");
+
+my @kids;
+
+# Children leave with _exit() so they don't run the server object's
+# destructor and take memcached down with them.
+
+# incrementers
+for my $i (1 .. $incrementers) {
+    my $pid = fork();
+    die "fork: $!" unless defined $pid;
+    if ($pid == 0) {
+        my $sock = $server->new_sock;
+        my $done = 0;
+        while ($done < $increments) {
+            print $sock "gets counter\r\n";
+            _exit(1) unless <$sock> =~ /^VALUE counter 0 \d+ (\d+)\r\n$/;
+            my $cas = $1;
+            my $val = <$sock>;
+            <$sock>;
+            chomp($val);
+            $val =~ s/\r$//;
+            $val++;
+            print $sock "cas counter 0 0 " . length($val) . " $cas\r\n$val\r\n";
+            my $res = <$sock>;
+            if ($res eq "STORED\r\n") {
+                $done++;
+            } elsif ($res ne "EXISTS\r\n") {
+                _exit(2);
+            }
+        }
+        _exit(0);
+    }
+    push(@kids, $pid);
+}
+
+# setters
+for my $s (1 .. 2) {
+    my $pid = fork();
+    die "fork: $!" unless defined $pid;
+    if ($pid == 0) {
+        my $sock = $server->new_sock;
+        for my $n (1 .. 5000) {
+            my $key = "key" . ($n % $keys);
+            print $sock "set $key 0 0 1\r\n$s\r\n";
+            _exit(1) unless <$sock> eq "STORED\r\n";
+        }
+        _exit(0);
+    }
+    push(@kids, $pid);
+}
+
+my $i = 0;
+for my $pid (@kids) {
+    waitpid($pid, 0);
+    my $who = $i++ < $incrementers ? "incrementer" : "setter";
+    is($? >> 8, 0, "$who $pid finished cleanly");
+}
+
+mem_get_is($sock, "counter", $incrementers * $increments);
+
+# No two items share a CAS id, whichever threads stored them.
+print $sock "gets " . join(' ', map { "key$_" } (0 .. $keys - 1)) . "\r\n";
+my %seen;
+my $dups = 0;
+while (my $line = <$sock>) {
+    last if $line eq "END\r\n";
+    $dups++ if $line =~ /^VALUE \S+ 0 1 (\d+)\r\n$/ && $seen{$1}++;
+    <$sock>;
+}
+is($dups, 0, "CAS ids are unique");
@@ -0,0 +1,78 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# A value that doesn't repeat within a chunk, so misplaced chunks show up.
+sub value {
+    my ($len, $seed) = @_;
+    my $val = '';
+    my $i = $seed;
+    $val .= sprintf("%08x", $i++) while length($val) < $len;
+    return substr($val, 0, $len);
+}
+
+sub store {
+    my ($sock, $cmd, $key, $val) = @_;
+    my $len = length($val);
+    print $sock "$cmd $key 0 0 $len\r\n$val\r\n";
+    is(scalar <$sock>, "STORED\r\n", "$cmd $key, $len bytes");
+}
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{slab_page_size}, 1024 * 1024, "1MB slab pages");
+is($settings->{slab_chunk_max}, 512 * 1024, "chunks of up to half a page");
+
+# Just past the largest slab class, and the most that fits in 1MB.
+my $big = value(600 * 1024, 0);
+store($sock, "set", "big", $big);
+mem_get_is($sock, "big", $big);
+my $max = value(1024 * 1024 - 512, 7);
+store($sock, "set", "max", $max);
+mem_get_is($sock, "max", $max);
+
+my $stats = mem_stats($sock);
+cmp_ok($stats->{bytes}, '>', length($big) + length($max),
+       "bytes counts the chunks");
+
+store($sock, "append", "big", "tail");
+store($sock, "prepend", "big", "head");
+mem_get_is($sock, "big", "head" . $big . "tail");
+
+print $sock "incr big 1\r\n";
+is(scalar <$sock>, "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n",
+   "chunked values aren't numbers");
+
+# The value must still end in \r\n.
+my $len = length($big);
+print $sock "set bad 0 0 $len\r\n${big}XX\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad data chunk\r\n", "bad data chunk");
+$server->stop;
+
+# Many small chunks, and the short last one from a smaller class.
+$server = new_memcached('-o slab_chunk_max=4096');
+$sock = $server->sock;
+my $val = value(100 * 1024 + 17, 3);
+store($sock, "set", "small", $val);
+mem_get_is($sock, "small", $val);
+$server->stop;
+
+# Values far beyond a slab page.
+$server = new_memcached('-I 16m -m 128');
+$sock = $server->sock;
+$settings = mem_stats($sock, ' settings');
+is($settings->{slab_page_size}, 1024 * 1024, "pages stay 1MB with -I 16m");
+$val = value(16 * 1024 * 1024 - 1024, 11);
+store($sock, "set", "huge", $val);
+mem_get_is($sock, "huge", $val);
+
+eval {
+    new_memcached('-o slab_chunk_max=256');
+};
+ok($@ && $@ =~ m/^Failed/, "slab_chunk_max can't be tiny");
@@ -0,0 +1,120 @@
+#!/usr/bin/perl
+# With -o epoch_reclaim, GET sends items without taking references on them.
+# Items must stay intact while a slow client's reply is still being written,
+# and evictions still have to find memory.
+
+use strict;
+use warnings;
+use Test::More tests => 15;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+use POSIX ();
+
+my $server = new_memcached("-m 64 -o epoch_reclaim");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{epoch_reclaim}, 'yes', "epoch_reclaim set");
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "bar");
+print $sock "delete foo\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted foo");
+mem_get_is($sock, "foo", undef);
+
+# A reply too big to be written at once, which the client doesn't read
+# until the keys in it were replaced and their memory used again.
+my $len = 200000;
+my @keys = map { "big$_" } 1 .. 40;
+for my $key (@keys) {
+    my $val = substr($key x $len, 0, $len);
+    print $sock "set $key 0 0 $len\r\n$val\r\n";
+    <$sock>;
+}
+my $slow = $server->new_sock;
+print $slow "get @keys\r\n";
+sleep(1);
+
+for my $round (1 .. 3) {
+    for my $key (@keys) {
+        my $val = substr("$round" x $len, 0, $len);
+        print $sock "set $key 0 0 $len\r\n$val\r\n";
+        <$sock>;
+    }
+}
+for my $i (1 .. 400) {
+    my $val = 'x' x $len;
+    print $sock "set fill$i 0 0 $len\r\n$val\r\n";
+    <$sock>;
+}
+
+my $intact = 0;
+for my $key (@keys) {
+    my $head = <$slow>;
+    my $val = '';
+    read($slow, $val, $len + 2);
+    $intact++ if $head eq "VALUE $key 0 $len\r\n" &&
+        $val eq substr($key x $len, 0, $len) . "\r\n";
+}
+is($intact, scalar @keys, "the slow reply was sent as it was fetched");
+is(scalar <$slow>, "END\r\n", "slow reply ended");
+
+my $stats = mem_stats($sock);
+cmp_ok($stats->{evictions}, '>', 0, "the big sets evicted items");
+cmp_ok($stats->{epoch_reclaimed}, '>', 0, "and reused retired items");
+
+# Sets that fill the cache over and over still get memory.
+my $stored = 0;
+my $val = 'y' x 1000;
+for my $i (1 .. 20000) {
+    print $sock "set small$i 0 0 1000\r\n$val\r\n";
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, 20000, "every set found memory");
+mem_get_is($sock, "small20000", $val);
+$stats = mem_stats($sock);
+cmp_ok($stats->{epoch_limbo_items}, '<', 20000, "retired items are reclaimed");
+$server->stop;
+
+# Sets keep finding memory while readers are in and out of epochs all the
+# time. Readers leave with _exit() so they don't run the server object's
+# destructor and take memcached down with them.
+$server = new_memcached("-m 3 -t 4 -o epoch_reclaim");
+$sock = $server->sock;
+my $end = time() + 3;
+my @kids;
+for my $r (1 .. 4) {
+    my $pid = fork();
+    die "fork: $!" unless defined $pid;
+    if ($pid == 0) {
+        my $rsock = $server->new_sock;
+        while (time() < $end) {
+            my @k = map { "small" . int(rand(5000)) } (1 .. 20);
+            print $rsock "get @k\r\n";
+            while (my $line = <$rsock>) {
+                last if $line eq "END\r\n";
+            }
+        }
+        POSIX::_exit(0);
+    }
+    push(@kids, $pid);
+}
+$stored = 0;
+my $tried = 0;
+while (time() < $end) {
+    my $key = "small" . int(rand(5000));
+    print $sock "set $key 0 0 1000\r\n$val\r\n";
+    $tried++;
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+waitpid($_, 0) for @kids;
+is($stored, $tried, "sets found memory under GET load");
+$stats = mem_stats($sock);
+cmp_ok($stats->{evictions}, '>', 0, "and evicted meanwhile");
+$server->stop;
+
+$server = new_memcached();
+$stats = mem_stats($server->sock);
+ok(!exists $stats->{epoch_limbo_items}, "no epoch stats by default");
@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+# With -o evict_reserve, a background thread evicts to keep free chunks
+# ready, and sets take those instead of evicting themselves.
+
+use strict;
+use warnings;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 3");
+my $sock = $server->sock;
+my $stats = mem_stats($sock);
+ok(!exists $stats->{reserve_hits}, "no reserve stats by default");
+$server->stop;
+
+$server = new_memcached("-m 3 -o evict_reserve=50");
+$sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{evict_reserve}, 50, "evict_reserve set");
+
+my $value = "B" x 1000;
+my $ok = 0;
+my $key = 0;
+my ($items, $class);
+# Sets take free chunks from plain page allocations too, until memory is
+# full; only hits after evictions have started come from the reserve.
+while ($key < 10000) {
+    $key++;
+    print $sock "set key$key 0 0 1000\r\n$value\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+    next if $key % 100;
+    $items = mem_stats($sock, "items");
+    ($class) = map { /^items:(\d+):number$/ ? $1 : () } keys %$items;
+    last if $items->{"items:$class:evicted"};
+}
+ok(defined $class, "values went to one class");
+cmp_ok($items->{"items:$class:evicted"}, '>', 0, "items were evicted");
+my $hits = $items->{"items:$class:reserve_hits"};
+
+for (1 .. 5000) {
+    $key++;
+    print $sock "set key$key 0 0 1000\r\n$value\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+is($ok, $key, "stored more than fits");
+mem_get_is($sock, "key$key", $value, "last key is there");
+
+$items = mem_stats($sock, "items");
+cmp_ok($items->{"items:$class:reserve_hits"}, '>', $hits + 1000,
+       "sets took chunks from the reserve once memory was full");
+ok(exists $items->{"items:$class:reserve_misses"}, "reserve misses counted");
+
+# The evictor refills the reserve in the background.
+my $free = 0;
+for (1 .. 50) {
+    $free = mem_stats($sock, "slabs")->{"$class:free_chunks"};
+    last if $free >= 50;
+    select(undef, undef, undef, 0.1);
+}
+cmp_ok($free, '>=', 50, "reserve was refilled");
+
+$stats = mem_stats($sock);
+is($stats->{reserve_hits}, $items->{"items:$class:reserve_hits"},
+   "reserve hits in the totals");
+ok(exists $stats->{evictor_cpu_usec}, "evictor cpu time reported");
+
+eval {
+    new_memcached('-M -o evict_reserve=50');
+};
+ok($@ && $@ =~ m/^Failed/, "evict_reserve can't be used with -M");
@@ -0,0 +1,81 @@
+#!/usr/bin/perl
+# With -o expiry_wheel, items are freed once they expire, without being
+# fetched, and touched or replaced items are left alone.
+
+use strict;
+use warnings;
+use Test::More tests => 11;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-o expiry_wheel");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{expiry_wheel}, 'yes', "expiry_wheel set");
+
+my $ok = 0;
+for my $key (1 .. 90) {
+    print $sock "set short$key 0 1 5\r\nshort\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+for my $key (1 .. 10) {
+    print $sock "set long$key 0 0 5\r\nlongv\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+# Stored with an expiry time, then given a later one or none.
+print $sock "set touched 0 1 5\r\ntouch\r\n";
+$ok++ if scalar <$sock> eq "STORED\r\n";
+print $sock "touch touched 100\r\n";
+$ok++ if scalar <$sock> eq "TOUCHED\r\n";
+print $sock "set replaced 0 1 5\r\nfirst\r\n";
+$ok++ if scalar <$sock> eq "STORED\r\n";
+print $sock "set replaced 0 0 5\r\nlater\r\n";
+$ok++ if scalar <$sock> eq "STORED\r\n";
+is($ok, 104, "stored short and long lived items");
+
+# Never fetch the short lived ones; the wheel has to free them.
+my $stats;
+for (1 .. 50) {
+    select(undef, undef, undef, 0.1);
+    $stats = mem_stats($sock);
+    last if $stats->{curr_items} == 12;
+}
+is($stats->{curr_items}, 12, "expired items were freed");
+
+my $items = mem_stats($sock, "items");
+my $freed = 0;
+for my $stat (keys %$items) {
+    $freed += $items->{$stat} if $stat =~ /:expired_freed$/;
+}
+is($freed, 90, "expired_freed counts them");
+
+mem_get_is($sock, "long1", "longv");
+mem_get_is($sock, "touched", "touch");
+mem_get_is($sock, "replaced", "later");
+
+# Overwriting a key leaves stale entries behind; they're swept or dropped
+# before the wheel of the class holds twice as many as it has chunks.
+for (1 .. 40000) {
+    print $sock "set churn 0 100 5 noreply\r\nchurn\r\n";
+}
+mem_get_is($sock, "churn", "churn");
+$items = mem_stats($sock, "items");
+my $slabs = mem_stats($sock, "slabs");
+my $over = 0;
+for my $stat (keys %$items) {
+    next unless $stat =~ /^items:(\d+):wheel_entries$/;
+    $over++ if $items->{$stat} > 2 * $slabs->{"$1:total_chunks"};
+}
+is($over, 0, "wheel entries are capped by the chunks of their class");
+$server->stop;
+
+$server = new_memcached();
+$sock = $server->sock;
+$settings = mem_stats($sock, ' settings');
+is($settings->{expiry_wheel}, 'no', "expiry_wheel is off by default");
+print $sock "set foo 0 100 3\r\nbar\r\n";
+<$sock>;
+$items = mem_stats($sock, "items");
+ok(!grep(/:expired_freed$/, keys %$items), "no expired_freed without it");
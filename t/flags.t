@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 6;
+use Test::More tests => 8;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -10,7 +10,7 @@ my $server = new_memcached();
 my $sock = $server->sock;
 
 # set foo (and should get it)
-for my $flags (0, 123, 2**16-1) {
+for my $flags (0, 123, 2**16-1, 2**32-1) {
     print $sock "set foo $flags 0 6\r\nfooval\r\n";
     is(scalar <$sock>, "STORED\r\n", "stored foo");
     mem_get_is({ sock => $sock,
@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 21;
+use Test::More tests => 27;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -54,3 +54,19 @@ print $sock "set foo2 0 0 5\r\n54321\r\n";
 is(scalar <$sock>, "STORED\r\n", "stored foo2 = '54321'");
 mem_get_is($sock, "foo", '12345');
 mem_get_is($sock, "foo2", '54321');
+
+# A flush that took effect stays in effect when a later one is delayed.
+print $sock "set old 0 0 3\r\nold\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored old");
+print $sock "flush_all\r\n";
+is(scalar <$sock>, "OK\r\n", "did flush_all");
+print $sock "flush_all 86400\r\n";
+is(scalar <$sock>, "OK\r\n", "did flush_all for far future");
+mem_get_is($sock, "old", undef);
+
+# Items only keep part of the flush generation. One that was never looked
+# at again must stay dead once the counter comes back round.
+print $sock "set wrap 0 0 4\r\nwrap\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored wrap");
+print $sock "flush_all noreply\r\n" x 65536;
+mem_get_is($sock, "wrap", undef);
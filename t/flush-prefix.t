@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 22;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+sub store {
+    my ($key, $val) = @_;
+    my $len = length($val);
+    print $sock "set $key 0 0 $len\r\n$val\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored $key");
+}
+
+store("user:1:name", "alice");
+store("user:1:cart:5", "book");
+store("user:12:name", "bob");
+store("user:1", "bare");
+
+print $sock "flush_prefix user:1\r\n";
+is(scalar <$sock>, "OK\r\n", "did flush_prefix");
+mem_get_is($sock, "user:1:name", undef);
+mem_get_is($sock, "user:1:cart:5", undef);
+mem_get_is($sock, "user:12:name", "bob");
+mem_get_is($sock, "user:1", "bare");
+
+# Items stored after the flush are visible again.
+store("user:1:name", "carol");
+mem_get_is($sock, "user:1:name", "carol");
+
+# A trailing delimiter is optional, and a wider prefix takes everything.
+print $sock "flush_prefix user: noreply\r\n";
+mem_get_is($sock, "user:1:name", undef);
+mem_get_is($sock, "user:12:name", undef);
+mem_get_is($sock, "user:1", undef);
+
+# Anything but noreply after the prefix is an error, and flushes nothing.
+store("user:1:name", "dave");
+print $sock "flush_prefix user: bogus\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n",
+   "flush_prefix with a bogus argument");
+mem_get_is($sock, "user:1:name", "dave");
+
+# Flushed items are swept out without being asked for.
+sub curr_items {
+    my $stats = mem_stats($sock);
+    return $stats->{curr_items};
+}
+store("sweep:$_", "x") foreach (1..2);
+my $before = curr_items();
+print $sock "flush_prefix sweep\r\n";
+is(scalar <$sock>, "OK\r\n", "did flush_prefix sweep");
+my $after = $before;
+for (1..50) {
+    $after = curr_items();
+    last if $after <= $before - 2;
+    select(undef, undef, undef, 0.1);
+}
+is($after, $before - 2, "flushed items were swept");
+
+# flush_prefix relies on CAS ids.
+my $nocas = new_memcached('-C');
+my $nsock = $nocas->sock;
+print $nsock "flush_prefix user:\r\n";
+is(scalar <$nsock>, "SERVER_ERROR flush_prefix needs CAS enabled\r\n",
+   "flush_prefix without CAS");
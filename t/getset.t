@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 539;
+use Test::More tests => 542;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -76,6 +76,29 @@ is(scalar <$sock>, "DELETED\r\n", "pipeline delete");
 is(scalar <$sock>, "STORED\r\n",  "pipeline set");
 is(scalar <$sock>, "DELETED\r\n", "pipeline delete");
 
+# multiget spanning several lookup batches, with misses mixed in
+{
+    my @keys = map { "mg$_" } (1 .. 100);
+    my $expect = '';
+    my $stored = 0;
+    for (my $i = 0; $i < @keys; $i += 2) {
+        print $sock "set $keys[$i] 0 0 " . length($i) . "\r\n$i\r\n";
+        $stored++ if scalar <$sock> eq "STORED\r\n";
+        $expect .= "VALUE $keys[$i] 0 " . length($i) . "\r\n$i\r\n";
+    }
+    is($stored, 50, "stored every other key");
+    foreach my $cmd ('get', 'gets') {
+        print $sock "$cmd @keys\r\n";
+        my $got = '';
+        while (my $line = <$sock>) {
+            last if $line eq "END\r\n";
+            $line =~ s/ \d+\r\n$/\r\n/ if $cmd eq 'gets';
+            $got .= $line;
+        }
+        is($got, $expect, "$cmd of 100 keys returns the 50 hits in order");
+    }
+}
+
 
 # Test sets up to a large size around 1MB.
 # Everything up to 1MB - 1k should succeed, everything 1MB +1k should fail.
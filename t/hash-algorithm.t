@@ -0,0 +1,44 @@
+#!/usr/bin/perl
+# Run the server with each key hash and check keys still round trip,
+# including across a hash table expansion.
+
+use strict;
+use warnings;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+for my $algo ('jenkins', 'murmur3', 'crc32c', 'siphash') {
+    my $server = new_memcached("-o hashpower=12,hash_algorithm=$algo");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, ' settings');
+    is($settings->{hash_algorithm}, $algo, "$algo: hash_algorithm set");
+
+    my $count = 8000;
+    my $bad = 0;
+    for my $i (1 .. $count) {
+        print $sock "set key$i 0 0 " . length("val$i") . "\r\nval$i\r\n";
+        $bad++ unless scalar(<$sock>) eq "STORED\r\n";
+    }
+    is($bad, 0, "$algo: stored all keys");
+
+    for (1 .. 50) {
+        last unless mem_stats($sock)->{hash_is_expanding};
+        select(undef, undef, undef, 0.1);
+    }
+
+    $bad = 0;
+    for my $i (1 .. $count) {
+        print $sock "get key$i\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE /) {
+            $bad++ unless scalar(<$sock>) eq "val$i\r\n";
+            $line = <$sock>;
+        } else {
+            $bad++;
+        }
+    }
+    is($bad, 0, "$algo: found all keys");
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/perl
+# Grow the hash table while clients keep using it, and make sure no key goes
+# missing along the way. Runs once per hash table layout.
+
+use strict;
+use warnings;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+for my $layout ('chained', 'bucketed') {
+    my $server = new_memcached("-o hashpower=12,hash_layout=$layout");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, ' settings');
+    is($settings->{hash_layout}, $layout, "$layout: layout set");
+
+    my $stats = mem_stats($sock);
+    is($stats->{hash_power_level}, 12, "$layout: starts at hashpower 12");
+    is($stats->{hash_buckets_moved}, 0, "$layout: no expansion running");
+
+    # Enough items to make either layout grow at least once.
+    my $count = 30000;
+    my $bad = 0;
+    for my $i (1 .. $count) {
+        print $sock "set key$i 0 0 " . length("val$i") . "\r\nval$i\r\n";
+        $bad++ unless scalar(<$sock>) eq "STORED\r\n";
+    }
+    is($bad, 0, "$layout: stored all keys during expansion");
+
+    for (1 .. 50) {
+        $stats = mem_stats($sock);
+        last unless $stats->{hash_is_expanding};
+        select(undef, undef, undef, 0.1);
+    }
+    cmp_ok($stats->{hash_power_level}, '>', 12, "$layout: hash table grew");
+
+    # Drop every third key, then check everything is where it should be.
+    $bad = 0;
+    for (my $i = 3; $i <= $count; $i += 3) {
+        print $sock "delete key$i\r\n";
+        $bad++ unless scalar(<$sock>) eq "DELETED\r\n";
+    }
+    is($bad, 0, "$layout: deleted every third key");
+
+    $bad = 0;
+    for my $i (1 .. $count) {
+        print $sock "get key$i\r\n";
+        my $line = <$sock>;
+        if ($i % 3 == 0) {
+            $bad++ unless $line eq "END\r\n";
+        } elsif ($line eq "VALUE key$i 0 " . length("val$i") . "\r\n") {
+            my $val = <$sock>;
+            my $end = <$sock>;
+            $bad++ unless $val eq "val$i\r\n" && $end eq "END\r\n";
+        } else {
+            $bad++;
+        }
+    }
+    is($bad, 0, "$layout: lookups right after expansion");
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/perl
+# Fill the hash table until it grows, delete nearly everything, and check it
+# shrinks back to its starting size without losing the keys that are left.
+# Runs once per hash table layout.
+
+use strict;
+use warnings;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+sub wait_resized {
+    my $sock = shift;
+    my $stats;
+    for (1 .. 100) {
+        $stats = mem_stats($sock);
+        last unless $stats->{hash_is_expanding} || $stats->{hash_is_shrinking};
+        select(undef, undef, undef, 0.1);
+    }
+    return $stats;
+}
+
+for my $layout ('chained', 'bucketed') {
+    my $server = new_memcached("-o hashpower=12,hash_layout=$layout,hash_shrink_pct=25");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, ' settings');
+    is($settings->{hash_shrink_pct}, 25, "$layout: hash_shrink_pct set");
+
+    my $count = 30000;
+    for my $i (1 .. $count) {
+        print $sock "set key$i 0 0 " . length("val$i") . "\r\nval$i\r\n";
+        scalar <$sock>;
+    }
+    my $stats = wait_resized($sock);
+    cmp_ok($stats->{hash_power_level}, '>', 12, "$layout: hash table grew");
+    my $grown_bytes = $stats->{hash_bytes};
+
+    # Keep every hundredth key.
+    for my $i (1 .. $count) {
+        next if $i % 100 == 0;
+        print $sock "delete key$i\r\n";
+        scalar <$sock>;
+    }
+
+    for (1 .. 100) {
+        $stats = wait_resized($sock);
+        last if $stats->{hash_power_level} == 12;
+        select(undef, undef, undef, 0.1);
+    }
+    is($stats->{hash_power_level}, 12, "$layout: shrank back to hashpower 12");
+    is($stats->{hash_is_shrinking}, 0, "$layout: shrink finished");
+    cmp_ok($stats->{hash_bytes}, '<', $grown_bytes, "$layout: hash_bytes went down");
+
+    my $bad = 0;
+    for my $i (1 .. $count) {
+        print $sock "get key$i\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE /) {
+            $bad++ if $i % 100;
+            $bad++ unless scalar(<$sock>) eq "val$i\r\n";
+            $line = <$sock>;
+        } else {
+            $bad++ unless $i % 100;
+        }
+    }
+    is($bad, 0, "$layout: kept keys found, deleted keys gone");
+}
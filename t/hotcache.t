@@ -0,0 +1,80 @@
+#!/usr/bin/perl
+# With -o hotcache, GETs of a hot key are served from the worker's own
+# cache, and every change to the key is still seen at once.
+
+use strict;
+use warnings;
+use Test::More tests => 56;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# One worker, so every GET goes through the same cache.
+my $server = new_memcached("-t 1 -o hotcache");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{hotcache}, 'yes', "hotcache set");
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "bar") for 1 .. 10;
+
+my $stats = mem_stats($sock, ' hotcache');
+cmp_ok($stats->{hits}, '>=', 5, "later GETs of foo hit the cache");
+
+print $sock "set foo 0 0 3\r\nbaz\r\n";
+<$sock>;
+mem_get_is($sock, "foo", "baz", "a set is seen");
+
+mem_get_is($sock, "foo", "baz") for 1 .. 5;
+print $sock "incr foo 1\r\n";
+is(scalar <$sock>, "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n",
+   "not a number");
+print $sock "set n 0 0 1\r\n5\r\n";
+<$sock>;
+mem_get_is($sock, "n", "5") for 1 .. 5;
+print $sock "incr n 1\r\n";
+<$sock>;
+mem_get_is($sock, "n", "6", "an incr is seen");
+
+print $sock "delete foo\r\n";
+<$sock>;
+mem_get_is($sock, "foo", undef, "a delete is seen");
+
+mem_get_is($sock, "n", "6") for 1 .. 5;
+print $sock "flush_all\r\n";
+<$sock>;
+mem_get_is($sock, "n", undef, "a flush is seen");
+
+$stats = mem_stats($sock, ' hotcache');
+cmp_ok($stats->{validation_fails}, '>=', 3, "stale entries were noticed");
+
+# The same hot key several times in one GET.
+print $sock "set foo 0 0 3\r\nbar\r\n";
+<$sock>;
+mem_get_is($sock, "foo", "bar") for 1 .. 5;
+print $sock "get foo foo foo\r\n";
+my $lines = join('', map { scalar <$sock> } 1 .. 7);
+is($lines, "VALUE foo 0 3\r\nbar\r\n" x 3 . "END\r\n", "repeated hot key");
+
+# Left alone, entries are dropped after a couple of seconds.
+sleep(4);
+$stats = mem_stats($sock, ' hotcache');
+cmp_ok($stats->{evictions}, '>=', 1, "idle entries are dropped");
+
+# Entries that keep being hit stay however long they've been cached.
+mem_get_is($sock, "foo", "bar") for 1 .. 5;
+my $evictions = mem_stats($sock, ' hotcache')->{evictions};
+for (1 .. 8) {
+    mem_get_is($sock, "foo", "bar");
+    select(undef, undef, undef, 0.5);
+}
+$stats = mem_stats($sock, ' hotcache');
+is($stats->{evictions}, $evictions, "busy entries are kept");
+$server->stop;
+
+$server = new_memcached();
+$sock = $server->sock;
+$stats = mem_stats($sock, ' hotcache');
+is($stats->{enabled}, 'no', "hotcache is off by default");
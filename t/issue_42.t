@@ -18,4 +18,7 @@ for ($key = 0; $key < 10; $key++) {
 
 my $first_stats = mem_stats($sock, "slabs");
 my $req = $first_stats->{"1:mem_requested"};
-ok ($req == "640" || $req == "800", "Check allocated size");
+# 10 items of header, CAS, "keyN\0" and "BBBBBBBBBB\r\n"; zero flags take no
+# space. The header is 48 bytes on 64-bit, 36 on 32-bit and 32 with
+# --enable-compact-items.
+ok ($req == "730" || $req == "610" || $req == "570", "Check allocated size");
@@ -0,0 +1,79 @@
+#!/usr/bin/perl
+# Walk the keys with the "keys" cursor, including across a hash table
+# expansion started halfway through the walk.
+
+use strict;
+use warnings;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Runs one batch, returning the next cursor and the KEY lines by key.
+sub keys_batch {
+    my ($sock, $cursor, $count) = @_;
+    my %lines;
+    print $sock "keys $cursor $count\r\n";
+    while (my $line = <$sock>) {
+        return ($1, \%lines) if $line =~ /^END (\d+)\r\n/;
+        die "bad line: $line" unless $line =~ /^KEY (\S+) (.*)\r\n/;
+        $lines{$1} = $2;
+    }
+}
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+print $sock "set foo 0 100 5\r\nhello\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+print $sock "set bar 0 0 3\r\nbye\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored bar");
+print $sock "set gone 0 0 1\r\nx\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored gone");
+print $sock "delete gone\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted gone");
+
+my ($cursor, $lines) = keys_batch($sock, 0, 10000);
+is($cursor, 0, "small cache walked in one batch");
+is_deeply([sort keys %$lines], ['bar', 'foo'], "listed live keys only");
+like($lines->{foo}, qr/^(99|100) 5 [01]$/, "ttl, size and idle time of foo");
+like($lines->{bar}, qr/^-1 3 [01]$/, "bar never expires");
+
+print $sock "keys foo\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n", "cursor must be a number");
+print $sock "keys 0 0\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n", "count can't be 0");
+$server->stop;
+
+for my $layout ('chained', 'bucketed') {
+    $server = new_memcached("-o hashpower=12,hash_layout=$layout");
+    $sock = $server->sock;
+
+    my $count = 1000;
+    for my $i (1 .. $count) {
+        print $sock "set key$i 0 0 1\r\nx\r\n";
+        <$sock>;
+    }
+
+    my %seen;
+    my $batches = 0;
+    $cursor = 0;
+    do {
+        ($cursor, $lines) = keys_batch($sock, $cursor, 50);
+        $seen{$_}++ for keys %$lines;
+        # Make the table grow halfway through the walk.
+        if (++$batches == 5) {
+            for my $i (1 .. 20000) {
+                print $sock "set more$i 0 0 1\r\nx\r\n";
+                <$sock>;
+            }
+        }
+    } while ($cursor != 0);
+
+    cmp_ok($batches, '>', 5, "$layout: walked in several batches");
+    my $missing = grep { !$seen{"key$_"} } 1 .. $count;
+    is($missing, 0, "$layout: every key there throughout was listed");
+    my $stats = mem_stats($sock);
+    cmp_ok($stats->{hash_power_level}, '>', 12, "$layout: hash table grew");
+    $server->stop;
+}
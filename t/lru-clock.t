@@ -0,0 +1,63 @@
+#!/usr/bin/perl
+# With -o lru_mode=clock, items that keep being fetched must survive a scan
+# of items that are only ever set once.
+
+use strict;
+use warnings;
+use Test::More tests => 7;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 3 -o lru_mode=clock");
+my $sock = $server->sock;
+my $value = "B"x66560;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{lru_mode}, 'clock', "lru_mode set");
+
+my $ok = 0;
+for my $key (1 .. 10) {
+    print $sock "set hot$key 0 0 66560\r\n$value\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+is($ok, 10, "stored the working set");
+
+sub fetch_working_set {
+    for my $key (1 .. 10) {
+        print $sock "get hot$key\r\n";
+        if (scalar <$sock> =~ /^VALUE/) {
+            <$sock> for (1 .. 2);
+        }
+    }
+}
+
+# A scan several times the size of memory, while the working set keeps
+# being read.
+$ok = 0;
+for my $batch (0 .. 14) {
+    fetch_working_set();
+    for my $key ($batch * 10 + 1 .. $batch * 10 + 10) {
+        print $sock "set scan$key 0 0 66560\r\n$value\r\n";
+        $ok++ if scalar <$sock> eq "STORED\r\n";
+    }
+}
+is($ok, 150, "stored the scan");
+
+my $stats = mem_stats($sock, "items");
+cmp_ok($stats->{"items:31:evicted"}, '>', 0, "scan caused evictions");
+cmp_ok($stats->{"items:31:clock_cleared"}, '>', 0, "clock spared fetched items");
+
+my $found = 0;
+for my $key (1 .. 10) {
+    print $sock "get hot$key\r\n";
+    my $line = <$sock>;
+    if ($line =~ /^VALUE/) {
+        $found++;
+        <$sock> for (1 .. 2);
+    }
+}
+is($found, 10, "working set survived the scan");
+
+print $sock "get scan1\r\n";
+is(scalar <$sock>, "END\r\n", "start of the scan was evicted");
@@ -0,0 +1,46 @@
+#!/usr/bin/perl
+# With -o lru_crawler, expired items are reclaimed without being fetched.
+
+use strict;
+use warnings;
+use Test::More tests => 6;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-o lru_crawler,lru_crawler_sleep=0");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{lru_crawler}, 'yes', "lru_crawler set");
+
+my $ok = 0;
+for my $key (1 .. 90) {
+    print $sock "set short$key 0 1 5\r\nshort\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+for my $key (1 .. 10) {
+    print $sock "set long$key 0 0 5\r\nlongv\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+is($ok, 100, "stored short and long lived items");
+
+# Never fetch the short lived ones; the crawler has to find them.
+my $stats;
+for (1 .. 50) {
+    select(undef, undef, undef, 0.1);
+    $stats = mem_stats($sock);
+    last if $stats->{curr_items} == 10;
+}
+is($stats->{curr_items}, 10, "expired items were reclaimed");
+
+my $items = mem_stats($sock, "items");
+my ($reclaimed, $duration) = (0, 0);
+for my $stat (keys %$items) {
+    $reclaimed += $items->{$stat} if $stat =~ /:crawler_reclaimed$/;
+    $duration++ if $stat =~ /:crawler_duration$/;
+}
+is($reclaimed, 90, "crawler_reclaimed counts them");
+ok($duration > 0, "crawler_duration is reported");
+
+mem_get_is($sock, "long1", "longv");
@@ -0,0 +1,76 @@
+#!/usr/bin/perl
+# With -o lru_mode=lfu or tinylfu, items that were fetched often must
+# survive a scan of items that are only ever set once.
+
+use strict;
+use warnings;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $value = "B"x66560;
+
+sub scan_test {
+    my ($mode, $args) = @_;
+    my $server = new_memcached("-m 3 -o $args");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, ' settings');
+    is($settings->{lru_mode}, $mode, "lru_mode set to $mode");
+
+    my $ok = 0;
+    for my $key (1 .. 10) {
+        print $sock "set hot$key 0 0 66560\r\n$value\r\n";
+        $ok++ if scalar <$sock> eq "STORED\r\n";
+    }
+    is($ok, 10, "$mode: stored the working set");
+
+    my $fetch = sub {
+        for my $key (1 .. 10) {
+            print $sock "get hot$key\r\n";
+            if (scalar <$sock> =~ /^VALUE/) {
+                <$sock> for (1 .. 2);
+            }
+        }
+    };
+
+    # Make the working set popular, then scan several times the size of
+    # memory. The working set is the oldest, so plain LRU would lose it.
+    $fetch->() for (1 .. 5);
+    $ok = 0;
+    for my $batch (0 .. 14) {
+        for my $key ($batch * 10 + 1 .. $batch * 10 + 10) {
+            print $sock "set scan$key 0 0 66560\r\n$value\r\n";
+            $ok++ if scalar <$sock> eq "STORED\r\n";
+        }
+    }
+    is($ok, 150, "$mode: stored the scan");
+
+    my $found = 0;
+    for my $key (1 .. 10) {
+        print $sock "get hot$key\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE/) {
+            $found++;
+            <$sock> for (1 .. 2);
+        }
+    }
+    is($found, 10, "$mode: working set survived the scan");
+
+    my $stats = mem_stats($sock);
+    cmp_ok($stats->{evictions}, '>', 0, "$mode: scan caused evictions");
+    return $stats;
+}
+
+scan_test('lfu', 'lru_mode=lfu');
+
+my $stats = scan_test('tinylfu', 'lru_segmented,lru_mode=tinylfu');
+cmp_ok($stats->{evictions_rejected}, '>', 0, "tinylfu rejected new items");
+is($stats->{evictions_admitted} + $stats->{evictions_rejected},
+   $stats->{evictions}, "every eviction admitted or rejected");
+
+eval {
+    new_memcached('-o lru_mode=tinylfu');
+};
+ok($@ && $@ =~ m/^Failed/, "tinylfu needs lru_segmented");
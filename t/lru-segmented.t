@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+# With -o lru_segmented, items that are being fetched must survive a scan
+# of items that are only ever set once.
+
+use strict;
+use warnings;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 3 -o lru_segmented");
+my $sock = $server->sock;
+my $value = "B"x66560;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{lru_segmented}, 'yes', "lru_segmented set");
+
+# The working set: stored, then fetched so it counts as in use.
+my $ok = 0;
+for my $key (1 .. 10) {
+    print $sock "set hot$key 0 0 66560\r\n$value\r\n";
+    $ok++ if scalar <$sock> eq "STORED\r\n";
+}
+is($ok, 10, "stored the working set");
+
+sub fetch_working_set {
+    for my $key (1 .. 10) {
+        print $sock "get hot$key\r\n";
+        if (scalar <$sock> =~ /^VALUE/) {
+            <$sock> for (1 .. 2);
+        }
+    }
+}
+fetch_working_set();
+
+# Give the maintainer time to move the fetched items up to WARM.
+my $stats;
+for (1 .. 50) {
+    select(undef, undef, undef, 0.1);
+    $stats = mem_stats($sock, "items");
+    last if ($stats->{"items:31:moves_to_warm"} || 0) > 0;
+}
+cmp_ok($stats->{"items:31:moves_to_warm"}, '>', 0, "fetched items moved to warm");
+
+# A scan several times the size of memory, while the working set keeps
+# being read.
+$ok = 0;
+for my $batch (0 .. 14) {
+    for my $key ($batch * 10 + 1 .. $batch * 10 + 10) {
+        print $sock "set scan$key 0 0 66560\r\n$value\r\n";
+        $ok++ if scalar <$sock> eq "STORED\r\n";
+    }
+    fetch_working_set();
+    select(undef, undef, undef, 0.05);
+}
+is($ok, 150, "stored the scan");
+
+$stats = mem_stats($sock, "items");
+cmp_ok($stats->{"items:31:evicted"}, '>', 0, "scan caused evictions");
+cmp_ok($stats->{"items:31:moves_to_cold"}, '>', 0, "scan went through cold");
+
+my $found = 0;
+for my $key (1 .. 10) {
+    print $sock "get hot$key\r\n";
+    my $line = <$sock>;
+    if ($line =~ /^VALUE/) {
+        $found++;
+        <$sock> for (1 .. 2);
+    }
+}
+is($found, 10, "working set survived the scan");
+
+print $sock "get scan1\r\n";
+is(scalar <$sock>, "END\r\n", "start of the scan was evicted");
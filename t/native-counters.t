@@ -0,0 +1,57 @@
+#!/usr/bin/perl
+# With -o native_counters, counters are kept as 64-bit integers once they
+# are incremented, and only turned back into ASCII when they are read.
+
+use strict;
+use warnings;
+use Test::More tests => 17;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-o native_counters");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{native_counters}, 'yes', "native_counters set");
+
+print $sock "set num 5 0 1\r\n1\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored num");
+print $sock "incr num 1\r\n";
+is(scalar <$sock>, "2\r\n", "+ 1 = 2");
+mem_get_is({ sock => $sock, flags => 5 }, "num", "2", "read back as ASCII");
+
+print $sock "gets num\r\n";
+my ($cas) = (scalar <$sock>) =~ /^VALUE num 5 1 (\d+)\r\n$/;
+ok($cas, "gets of a native counter");
+is(scalar <$sock>, "2\r\n", "gets value");
+is(scalar <$sock>, "END\r\n", "gets end");
+
+print $sock "incr num 8\r\n";
+is(scalar <$sock>, "10\r\n", "+ 8 = 10, one more digit");
+print $sock "cas num 0 0 1 $cas\r\nx\r\n";
+is(scalar <$sock>, "EXISTS\r\n", "incr changed the CAS");
+
+print $sock "decr num 100\r\n";
+is(scalar <$sock>, "0\r\n", "decr floors at zero");
+
+print $sock "set big 0 0 20\r\n18446744073709551615\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored 2**64 - 1");
+print $sock "incr big 1\r\n";
+is(scalar <$sock>, "0\r\n", "wrapped around");
+print $sock "incr big 18446744073709551615\r\n";
+is(scalar <$sock>, "18446744073709551615\r\n", "back to 2**64 - 1");
+
+print $sock "prepend big 0 0 1\r\nx\r\n";
+is(scalar <$sock>, "STORED\r\n", "prepended to a native counter");
+mem_get_is($sock, "big", "x18446744073709551615");
+print $sock "incr big 1\r\n";
+is(scalar <$sock>, "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n",
+   "no longer a number");
+
+my $ok = 0;
+for (1 .. 1000) {
+    print $sock "incr num 1\r\n";
+    $ok++ if scalar <$sock> eq "$_\r\n";
+}
+is($ok, 1000, "a thousand increments");
@@ -0,0 +1,106 @@
+#!/usr/bin/perl
+# Hammer the lock-free GET path with concurrent sets and deletes on a small
+# keyspace, and make sure readers never see a value that belongs to another
+# key or a torn one.
+
+use strict;
+use warnings;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+use POSIX qw(_exit);
+
+my $server = new_memcached('-t 4 -o optimistic_get,hashpower=12');
+my $stats = mem_stats($server->sock, ' settings');
+is($stats->{optimistic_get}, "yes", "optimistic_get enabled");
+
+my $runtime = 3;
+
+# Children leave with _exit() so they don't run the server object's
+# destructor and take memcached down with them. Writers delete every
+# $delete_every-th key they pick and set the rest to values of up to $max
+# bytes; readers check each value starts with its own key. Returns the
+# children's exit codes, writers first.
+sub hammer {
+    my ($server, $keys, $delete_every, $max) = @_;
+    my @kids;
+
+    # writers
+    for my $w (1 .. 2) {
+        my $pid = fork();
+        die "fork: $!" unless defined $pid;
+        if ($pid == 0) {
+            my $sock = $server->new_sock;
+            my $end = time() + $runtime;
+            my $n = 0;
+            while (time() < $end) {
+                my $key = "key" . int(rand($keys));
+                if ($delete_every && ++$n % $delete_every == 0) {
+                    print $sock "delete $key\r\n";
+                    my $res = <$sock>;
+                    _exit(1) unless $res =~ /^(DELETED|NOT_FOUND)\r\n$/;
+                } else {
+                    my $val = "$key:" . ('v' x int(rand($max)));
+                    print $sock "set $key $w 0 " . length($val) . "\r\n$val\r\n";
+                    my $res = <$sock>;
+                    _exit(1) unless $res eq "STORED\r\n";
+                }
+            }
+            _exit(0);
+        }
+        push(@kids, $pid);
+    }
+
+    # readers
+    for my $r (1 .. 3) {
+        my $pid = fork();
+        die "fork: $!" unless defined $pid;
+        if ($pid == 0) {
+            my $sock = $server->new_sock;
+            my $end = time() + $runtime;
+            while (time() < $end) {
+                my @k = map { "key" . int(rand($keys)) } (1 .. 10);
+                print $sock "get @k\r\n";
+                while (my $line = <$sock>) {
+                    last if $line eq "END\r\n";
+                    _exit(2) unless $line =~ /^VALUE (\S+) [12] (\d+)\r\n$/;
+                    my ($key, $len) = ($1, $2);
+                    my $data = '';
+                    read($sock, $data, $len + 2);
+                    _exit(3) unless $data =~ /^\Q$key\E:v*\r\n$/
+                        && length($data) == $len + 2;
+                }
+            }
+            _exit(0);
+        }
+        push(@kids, $pid);
+    }
+
+    return map { waitpid($_, 0); $? >> 8 } @kids;
+}
+
+# enough keys to force a hash table expansion
+my @codes = hammer($server, 8192, 4, 200);
+my $i = 0;
+for my $code (@codes) {
+    my $who = $i++ < 2 ? "writer" : "reader";
+    is($code, 0, "$who finished cleanly");
+}
+
+$stats = mem_stats($server->sock);
+ok($stats->{get_hits} > 0, "readers had hits");
+$server->stop;
+
+# Evictions reuse items readers may just have looked up.
+$server = new_memcached('-m 2 -t 4 -o optimistic_get');
+@codes = hammer($server, 4096, 0, 2000);
+$i = 0;
+for my $code (@codes) {
+    my $who = $i++ < 2 ? "writer" : "reader";
+    is($code, 0, "$who finished cleanly while evicting");
+}
+
+$stats = mem_stats($server->sock);
+ok($stats->{evictions} > 0, "items were evicted");
+ok($stats->{get_hits} > 0, "readers had hits while evicting");
@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 95;
+use Test::More tests => 96;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -58,7 +58,7 @@ my $sock = $server->sock;
 my $stats = mem_stats($sock);
 
 # Test number of keys
-is(scalar(keys(%$stats)), 48, "48 stats values");
+is(scalar(keys(%$stats)), 50, "50 stats values");
 
 # Test initial state
 foreach my $key (qw(curr_items total_items bytes cmd_get cmd_set get_hits evictions get_misses
@@ -194,3 +194,7 @@ is(scalar <$sock>, "OK\r\n", "flushed");
 
 my $stats = mem_stats($sock);
 is($stats->{cmd_flush}, 1, "after one flush cmd_flush is 1");
+
+# Item header plus CAS: 48 + 8, or 32 + 8 with --enable-compact-items.
+my $slabs = mem_stats($sock, "slabs");
+like($slabs->{item_header_size}, qr/^(56|40)$/, "item_header_size");
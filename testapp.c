@@ -22,6 +22,11 @@
 #include "cache.h"
 #include "util.h"
 #include "protocol_binary.h"
+#include "hash.h"
+#include "jenkins_hash.h"
+#include "murmur3_hash.h"
+#include "crc32c_hash.h"
+#include "siphash.h"
 
 #define TMP_TEMPLATE "/tmp/test_file.XXXXXXX"
 
@@ -410,6 +415,43 @@ static pid_t start_server(in_port_t *port_out, bool daemon, int timeout) {
     return pid;
 }
 
+static enum test_return test_hash_algorithms(void) {
+    static const char fox[] = "The quick brown fox jumps over the lazy dog";
+    uint8_t sipkey[16], msg[15];
+    enum hashfunc_type type;
+    int i;
+
+    // Reference vectors from each algorithm's authors.
+    assert(jenkins_hash("", 0, 0) == 0xdeadbeef);
+    assert(murmur3_hash("", 0, 0) == 0);
+    assert(murmur3_hash("hello", 5, 0) == 0x248bfa47);
+    assert(murmur3_hash(fox, strlen(fox), 0) == 0x2e4ff723);
+
+    // Check both the table and (if the CPU has it) the SSE4.2 path.
+    crc32c_init();
+    assert(crc32c(0, "123456789", 9) == 0xe3069283);
+    assert(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xe3069283);
+
+    for (i = 0; i < 16; i++) {
+        sipkey[i] = i;
+    }
+    for (i = 0; i < 15; i++) {
+        msg[i] = i;
+    }
+    assert(siphash24(sipkey, msg, 15) == 0xa129ca6149be45e5ULL);
+
+    // Every name round trips through the option parser.
+    for (i = JENKINS_HASH; i <= SIPHASH_HASH; i++) {
+        assert(hash_type_from_name(hash_type_name(i), &type));
+        assert(type == i);
+        assert(hash_init(type) == 0);
+        assert(strcmp(hash_algorithm(), hash_type_name(i)) == 0);
+    }
+    assert(!hash_type_from_name("md5", &type));
+    hash_init(JENKINS_HASH);
+    return TEST_PASS;
+}
+
 static enum test_return test_issue_44(void) {
     in_port_t port;
     pid_t pid = start_server(&port, true, 15);
@@ -1893,6 +1935,7 @@ struct testcase testcases[] = {
     { "strtoll", test_safe_strtoll },
     { "strtoul", test_safe_strtoul },
     { "strtoull", test_safe_strtoull },
+    { "hash_algorithms", test_hash_algorithms },
     { "issue_44", test_issue_44 },
     { "vperror", test_vperror },
     { "issue_101", test_issue_101 },
@@ -38,9 +38,6 @@ struct conn_queue {
     pthread_cond_t  cond;
 };
 
-/* Lock for cache operations (item_*, assoc_*) */
-pthread_mutex_t cache_lock;
-
 /* Connection lock around accepting new connections */
 pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -58,6 +55,14 @@ static pthread_mutex_t cqi_freelist_lock;
 static pthread_mutex_t *item_locks;
 /* size of the item lock hash table */
 static uint32_t item_lock_count;
+/* Sequence counters, one per item lock. Writers bump the counter to an odd
+ * value before changing a hash chain and back to an even one when done, so
+ * readers can walk a chain without the lock and check nothing moved under
+ * them. See item_get(). */
+static unsigned int *item_lock_seqs;
+/* The stripe a hash value maps to. This must not depend on hashpower, which
+ * changes while other threads hold item locks during a table expansion. */
+#define ITEM_LOCK_IDX(hv) ((hv) & (item_lock_count - 1))
 #define hashsize(n) ((unsigned long int)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 /* this lock is temporarily engaged during a hash table expansion */
@@ -113,6 +118,127 @@ unsigned short refcount_decr(unsigned short *refcount) {
 #endif
 }
 
+/* Takes a reference only if the item still holds at least one. Returns false
+ * when the count already dropped to zero, meaning the item is free or about
+ * to be freed and must not be touched. */
+bool refcount_incr_nonzero(unsigned short *refcount) {
+#ifdef HAVE_GCC_ATOMICS
+    unsigned short old;
+    do {
+        old = *(volatile unsigned short *)refcount;
+        if (old == 0)
+            return false;
+    } while (!__sync_bool_compare_and_swap(refcount, old, old + 1));
+    return true;
+#elif defined(__sun)
+    unsigned short old;
+    do {
+        old = *(volatile unsigned short *)refcount;
+        if (old == 0)
+            return false;
+    } while (atomic_cas_16(refcount, old, old + 1) != old);
+    return true;
+#else
+    bool res = false;
+    mutex_lock(&atomics_mutex);
+    if (*refcount != 0) {
+        (*refcount)++;
+        res = true;
+    }
+    mutex_unlock(&atomics_mutex);
+    return res;
+#endif
+}
+
+/* Reads the value of a native counter without holding its lock. */
+uint64_t item_counter_get(item *it) {
+    uint64_t *counter = ITEM_counter(it);
+#ifdef HAVE_GCC_64ATOMICS
+    return __sync_fetch_and_add(counter, 0);
+#elif defined(__sun)
+    return atomic_add_64_nv(counter, 0);
+#else
+    uint64_t res;
+    mutex_lock(&atomics_mutex);
+    res = *counter;
+    mutex_unlock(&atomics_mutex);
+    return res;
+#endif
+}
+
+/* Sets the value of a native counter, so that lock-free readers never see
+ * half of it. The caller holds the item lock. */
+void item_counter_set(item *it, const uint64_t value) {
+    uint64_t *counter = ITEM_counter(it);
+#ifdef HAVE_GCC_64ATOMICS
+    uint64_t old;
+    do {
+        old = *(volatile uint64_t *)counter;
+    } while (!__sync_bool_compare_and_swap(counter, old, value));
+#elif defined(__sun)
+    atomic_swap_64(counter, value);
+#else
+    mutex_lock(&atomics_mutex);
+    *counter = value;
+    mutex_unlock(&atomics_mutex);
+#endif
+}
+
+/* Sets flag bits on an item without holding its lock. */
+void item_flags_set(item *it, const uint16_t flags) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_fetch_and_or(&it->it_flags, flags);
+#elif defined(__sun)
+    atomic_or_16(&it->it_flags, flags);
+#else
+    mutex_lock(&atomics_mutex);
+    it->it_flags |= flags;
+    mutex_unlock(&atomics_mutex);
+#endif
+}
+
+/* Clears flag bits on an item, without losing bits that lock-free readers
+ * set meanwhile with item_flags_set(). */
+void item_flags_clear(item *it, const uint16_t flags) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_fetch_and_and(&it->it_flags, (uint16_t)~flags);
+#elif defined(__sun)
+    atomic_and_16(&it->it_flags, (uint16_t)~flags);
+#else
+    mutex_lock(&atomics_mutex);
+    it->it_flags &= ~flags;
+    mutex_unlock(&atomics_mutex);
+#endif
+}
+
+/* Called by writers holding the item lock for hv, once before and once after
+ * modifying the hash chain. */
+void item_lock_seq_bump(uint32_t hv) {
+    unsigned int *seq = &item_lock_seqs[ITEM_LOCK_IDX(hv)];
+#ifdef HAVE_GCC_ATOMICS
+    __sync_add_and_fetch(seq, 1);
+#elif defined(__sun)
+    atomic_inc_uint(seq);
+#else
+    mutex_lock(&atomics_mutex);
+    (*seq)++;
+    mutex_unlock(&atomics_mutex);
+#endif
+}
+
+/* Returns the current sequence for the chain hv lives in. Odd means a writer
+ * is in the middle of changing it. */
+unsigned int item_lock_seq(uint32_t hv) {
+    unsigned int seq;
+    seq = *(volatile unsigned int *)&item_lock_seqs[ITEM_LOCK_IDX(hv)];
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#elif defined(__sun)
+    membar_consumer();
+#endif
+    return seq;
+}
+
 /* Convenience functions for calling *only* when in ITEM_LOCK_GLOBAL mode */
 void item_lock_global(void) {
     mutex_lock(&item_global_lock);
@@ -125,12 +251,49 @@ void item_unlock_global(void) {
 void item_lock(uint32_t hv) {
     uint8_t *lock_type = pthread_getspecific(item_lock_type_key);
     if (likely(*lock_type == ITEM_LOCK_GRANULAR)) {
-        mutex_lock(&item_locks[(hv & hashmask(hashpower)) % item_lock_count]);
+        mutex_lock(&item_locks[ITEM_LOCK_IDX(hv)]);
     } else {
         mutex_lock(&item_global_lock);
     }
 }
 
+/* Locks every stripe the keys in bucket of a table of hashsize(power) can map
+ * to, in ascending order. Usually that is a single stripe; the loop only
+ * runs when there are more lock stripes than buckets. Used by the hash table
+ * expander while it migrates the bucket. */
+void item_lock_bucket(uint32_t bucket, unsigned int power) {
+    unsigned long int i;
+    for (i = ITEM_LOCK_IDX(bucket); i < item_lock_count; i += hashsize(power)) {
+        mutex_lock(&item_locks[i]);
+    }
+}
+
+void item_unlock_bucket(uint32_t bucket, unsigned int power) {
+    unsigned long int i;
+    for (i = ITEM_LOCK_IDX(bucket); i < item_lock_count; i += hashsize(power)) {
+        mutex_unlock(&item_locks[i]);
+    }
+}
+
+/* Takes every stripe, for swapping the hash table itself. Optimistic readers
+ * are told all chains changed. Nobody blocks on a second item lock while
+ * holding one, so taking them in order can't deadlock. */
+void item_lock_all(void) {
+    uint32_t i;
+    for (i = 0; i < item_lock_count; i++) {
+        mutex_lock(&item_locks[i]);
+        item_lock_seq_bump(i);
+    }
+}
+
+void item_unlock_all(void) {
+    uint32_t i;
+    for (i = 0; i < item_lock_count; i++) {
+        item_lock_seq_bump(i);
+        mutex_unlock(&item_locks[i]);
+    }
+}
+
 /* Special case. When ITEM_LOCK_GLOBAL mode is enabled, this should become a
  * no-op, as it's only called from within the item lock if necessary.
  * However, we can't mix a no-op and threads which are still synchronizing to
@@ -139,7 +302,7 @@ void item_lock(uint32_t hv) {
  * switch so it should stay safe.
  */
 void *item_trylock(uint32_t hv) {
-    pthread_mutex_t *lock = &item_locks[(hv & hashmask(hashpower)) % item_lock_count];
+    pthread_mutex_t *lock = &item_locks[ITEM_LOCK_IDX(hv)];
     if (pthread_mutex_trylock(lock) == 0) {
         return lock;
     }
@@ -153,7 +316,7 @@ void item_trylock_unlock(void *lock) {
 void item_unlock(uint32_t hv) {
     uint8_t *lock_type = pthread_getspecific(item_lock_type_key);
     if (likely(*lock_type == ITEM_LOCK_GRANULAR)) {
-        mutex_unlock(&item_locks[(hv & hashmask(hashpower)) % item_lock_count]);
+        mutex_unlock(&item_locks[ITEM_LOCK_IDX(hv)]);
     } else {
         mutex_unlock(&item_global_lock);
     }
@@ -323,6 +486,140 @@ void accept_new_conns(const bool do_accept) {
 }
 /****************************** LIBEVENT THREADS *****************************/
 
+/*
+ * Per-thread hot item cache (-o hotcache). Each worker keeps a reference to
+ * a few items its GETs keep asking for. A hit on one takes no item lock and
+ * leaves the item's refcount alone: the connection borrows the cache's
+ * reference, and gives it back through item_release(). Every hit checks the
+ * item is still linked, live and has the CAS it had when it was cached, so
+ * a set, delete, flush or in-place change is seen at once. A key is cached
+ * after HOTCACHE_ADMIT fetches in a row among the keys of its slot, and
+ * entries that haven't been hit for HOTCACHE_AGE seconds are dropped, so
+ * items aren't held on to once they cool down.
+ */
+#define HOTCACHE_SLOTS 64
+#define HOTCACHE_ADMIT 4
+#define HOTCACHE_AGE 2
+
+typedef struct {
+    item *it;               /* we hold a reference to it, or NULL */
+    uint32_t hv;
+    uint64_t cas;           /* the CAS of it when cached */
+    rel_time_t time;        /* when it was last hit, or cached */
+    unsigned int borrowed;  /* lent out on our reference */
+    uint32_t candidate;     /* hash of the key last fetched through here */
+    unsigned int fetches;   /* how many times in a row it was */
+} hotcache_slot_t;
+
+struct hotcache {
+    hotcache_slot_t slots[HOTCACHE_SLOTS];
+    struct event sweep_event;
+    /* Counted here, and added to the thread's stats after each batch. */
+    uint64_t hits;
+    uint64_t invalid;
+    uint64_t evictions;
+};
+
+/* Stops caching the item of slot. References still lent out on ours are
+ * turned into references of their own. */
+static void hotcache_drop(hotcache_slot_t *slot) {
+    item *it = slot->it;
+
+    slot->it = NULL;
+    for (; slot->borrowed > 0; slot->borrowed--)
+        refcount_incr(&it->refcount);
+    item_remove(it);
+}
+
+/* Returns the cached item for key, lent out, or NULL. */
+static item *hotcache_get(struct hotcache *hc, const char *key,
+                          const size_t nkey, const uint32_t hv) {
+    hotcache_slot_t *slot = &hc->slots[hv & (HOTCACHE_SLOTS - 1)];
+    item *it = slot->it;
+
+    if (it == NULL || slot->hv != hv || it->nkey != nkey ||
+        memcmp(ITEM_key(it), key, nkey) != 0)
+        return NULL;
+    if (ITEM_get_cas(it) != slot->cas || !item_is_live(it)) {
+        hc->invalid++;
+        hotcache_drop(slot);
+        return NULL;
+    }
+    item_count_fetch(hv);
+    /* In an epoch the caller needs no reference of its own */
+    if (!settings.epoch_reclaim)
+        slot->borrowed++;
+    slot->fetches = 0;
+    slot->time = current_time;
+    hc->hits++;
+    return it;
+}
+
+/* Called with each item a GET fetched the slow way; caches it if its key
+ * has been asked for often enough. */
+static void hotcache_offer(struct hotcache *hc, item *it, const uint32_t hv) {
+    hotcache_slot_t *slot = &hc->slots[hv & (HOTCACHE_SLOTS - 1)];
+
+    if (slot->candidate != hv) {
+        slot->candidate = hv;
+        slot->fetches = 1;
+        return;
+    }
+    if (++slot->fetches < HOTCACHE_ADMIT)
+        return;
+    if (slot->it != NULL) {
+        hc->evictions++;
+        hotcache_drop(slot);
+    }
+    refcount_incr(&it->refcount);
+    slot->it = it;
+    slot->hv = hv;
+    slot->cas = ITEM_get_cas(it);
+    slot->time = current_time;
+    slot->fetches = 0;
+}
+
+static void hotcache_stats_flush(LIBEVENT_THREAD *t) {
+    struct hotcache *hc = t->hotcache;
+
+    if (hc->hits == 0 && hc->invalid == 0 && hc->evictions == 0)
+        return;
+    pthread_mutex_lock(&t->stats.mutex);
+    t->stats.hotcache_hits += hc->hits;
+    t->stats.hotcache_invalid += hc->invalid;
+    t->stats.hotcache_evictions += hc->evictions;
+    pthread_mutex_unlock(&t->stats.mutex);
+    hc->hits = hc->invalid = hc->evictions = 0;
+}
+
+/* Runs every second in each worker, dropping entries that have gone idle or
+ * whose item has gone. */
+static void hotcache_sweep(const int fd, const short which, void *arg) {
+    LIBEVENT_THREAD *me = arg;
+    struct hotcache *hc = me->hotcache;
+    struct timeval t = {.tv_sec = 1, .tv_usec = 0};
+    int i;
+
+    for (i = 0; i < HOTCACHE_SLOTS; i++) {
+        hotcache_slot_t *slot = &hc->slots[i];
+        if (slot->it == NULL)
+            continue;
+        if (!item_is_live(slot->it) ||
+            ITEM_get_cas(slot->it) != slot->cas) {
+            hc->invalid++;
+            hotcache_drop(slot);
+        } else if (slot->time + HOTCACHE_AGE <= current_time) {
+            hc->evictions++;
+            hotcache_drop(slot);
+        }
+    }
+    hotcache_stats_flush(me);
+
+    evtimer_set(&hc->sweep_event, hotcache_sweep, me);
+    event_base_set(me->base, &hc->sweep_event);
+    evtimer_add(&hc->sweep_event, &t);
+}
+
 /*
  * Set up a thread's information.
  */
@@ -361,6 +658,15 @@ static void setup_thread(LIBEVENT_THREAD *me) {
         fprintf(stderr, "Failed to create suffix cache\n");
         exit(EXIT_FAILURE);
     }
+
+    if (settings.hotcache) {
+        me->hotcache = calloc(1, sizeof(struct hotcache));
+        if (me->hotcache == NULL) {
+            fprintf(stderr, "Failed to create hot item cache\n");
+            exit(EXIT_FAILURE);
+        }
+        hotcache_sweep(0, 0, me);
+    }
 }
 
 /*
@@ -476,6 +782,73 @@ int is_listen_thread() {
     return pthread_self() == dispatcher_thread.thread_id;
 }
 
+/*********************************** EPOCHS **********************************/
+
+/*
+ * With -o epoch_reclaim, a GET takes no reference on the items it sends.
+ * Instead its worker announces the current epoch before the first lookup,
+ * and goes back to 0 once none of its connections holds such items: when
+ * their reply has been written or, if the socket would block, once they're
+ * pinned with real references. items.c tags each item it retires with an
+ * epoch and frees it only after every worker has left that epoch.
+ */
+static volatile uint32_t epoch_global = 1;
+
+/* Orders a worker's announcement before its lookups, and the retirements
+ * before the scan in epoch_oldest(). */
+static inline void epoch_barrier(void) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#elif defined(__sun)
+    membar_enter();
+#else
+    mutex_lock(&atomics_mutex);
+    mutex_unlock(&atomics_mutex);
+#endif
+}
+
+/* Called by a connection about to hold items without references. */
+void epoch_enter(LIBEVENT_THREAD *t) {
+    if (t->epoch_holders++ == 0) {
+        t->epoch = epoch_global;
+        epoch_barrier();
+    }
+}
+
+/* Called once that connection has let go of them. */
+void epoch_exit(LIBEVENT_THREAD *t) {
+    assert(t->epoch_holders > 0);
+    if (--t->epoch_holders == 0) {
+        epoch_barrier();
+        t->epoch = 0;
+    }
+}
+
+/* Ends the current epoch and returns it. Only called by items.c under its
+ * limbo lock. */
+uint32_t epoch_advance(void) {
+    uint32_t e = epoch_global;
+    epoch_barrier();
+    /* 0 is what a quiescent worker announces */
+    epoch_global = (e + 1 == 0) ? 1 : e + 1;
+    return e;
+}
+
+/* The oldest epoch a worker is still in, or the current one if they're all
+ * quiescent. Anything retired in an epoch before it can be freed. */
+uint32_t epoch_oldest(void) {
+    uint32_t oldest = epoch_global;
+    int i;
+
+    epoch_barrier();
+    for (i = 0; threads != NULL && i < settings.num_threads; i++) {
+        uint32_t e = threads[i].epoch;
+        if (e != 0 && EPOCH_BEFORE(e, oldest))
+            oldest = e;
+    }
+    return oldest;
+}
+
 /********************************* ITEM ACCESS *******************************/
 
 /*
@@ -488,24 +861,95 @@ item *item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbyt
     return it;
 }
 
+/* item_get() for a key whose hash the caller already has. Without ref, the
+ * caller is inside an epoch and gets the item without a reference. */
+static item *item_get_hv(const char *key, const size_t nkey, const uint32_t hv,
+                         const bool ref) {
+    item *it;
+    item_count_fetch(hv);
+    if (settings.optimistic_get) {
+        /* Try the lock-free path first. It is only valid while we use the
+         * granular locks; the hash table is reshaped under the global one. */
+        uint8_t *lock_type = pthread_getspecific(item_lock_type_key);
+        if (likely(*lock_type == ITEM_LOCK_GRANULAR) &&
+            item_get_optimistic(key, nkey, hv, &it, ref)) {
+            return it;
+        }
+    }
+    item_lock(hv);
+    it = ref ? do_item_get(key, nkey, hv) : do_item_get_unref(key, nkey, hv);
+    item_unlock(hv);
+    return it;
+}
+
 /*
  * Returns an item if it hasn't been marked as expired,
  * lazy-expiring as needed.
  */
 item *item_get(const char *key, const size_t nkey) {
-    item *it;
-    uint32_t hv;
-    hv = hash(key, nkey, 0);
-    item_lock(hv);
-    it = do_item_get(key, nkey, hv);
-    item_unlock(hv);
-    return it;
+    return item_get_hv(key, nkey, hash(key, nkey, 0), true);
+}
+
+/*
+ * First half of a batched lookup: hashes every key into hvs and asks the
+ * CPU to start loading each key's bucket. Nothing is locked or read from
+ * the table, so it is also fine to call for keys that may never be fetched.
+ */
+void item_prefetch_batch(char **keys, const size_t *nkeys, uint32_t *hvs,
+                         const int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        hvs[i] = hash(keys[i], nkeys[i], 0);
+        assoc_prefetch(hvs[i]);
+    }
+}
+
+/*
+ * item_get() for count keys at once, storing each result (or NULL) in
+ * items. All buckets are requested before any chain is walked, so the
+ * cache misses of the batch overlap instead of being paid one by one.
+ * With -o epoch_reclaim the caller has entered an epoch, and the items come
+ * without references.
+ */
+void item_get_batch(LIBEVENT_THREAD *t, char **keys, const size_t *nkeys,
+                    item **items, const int count) {
+    uint32_t hvs[ITEM_BATCH_MAX];
+    struct hotcache *hc = t->hotcache;
+    const bool ref = !settings.epoch_reclaim;
+    int i;
+
+    assert(count <= ITEM_BATCH_MAX);
+    assert(ref || t->epoch != 0);
+    item_prefetch_batch(keys, nkeys, hvs, count);
+    for (i = 0; i < count; i++) {
+        if (hc != NULL &&
+            (items[i] = hotcache_get(hc, keys[i], nkeys[i], hvs[i])) != NULL)
+            continue;
+        items[i] = item_get_hv(keys[i], nkeys[i], hvs[i], ref);
+        if (hc != NULL && items[i] != NULL)
+            hotcache_offer(hc, items[i], hvs[i]);
+    }
+    if (hc != NULL)
+        hotcache_stats_flush(t);
+}
+
+/* Drops a reference item_get_batch() handed out. */
+void item_release(LIBEVENT_THREAD *t, item *it) {
+    if (t->hotcache != NULL) {
+        hotcache_slot_t *slot = &t->hotcache->slots[ITEM_hv(it) & (HOTCACHE_SLOTS - 1)];
+        if (slot->it == it && slot->borrowed > 0) {
+            slot->borrowed--;
+            return;
+        }
+    }
+    item_remove(it);
 }
 
 item *item_touch(const char *key, size_t nkey, uint32_t exptime) {
     item *it;
     uint32_t hv;
     hv = hash(key, nkey, 0);
+    item_count_fetch(hv);
     item_lock(hv);
     it = do_item_touch(key, nkey, exptime, hv);
     item_unlock(hv);
@@ -519,7 +963,7 @@ int item_link(item *item) {
     int ret;
     uint32_t hv;
 
-    hv = hash(ITEM_key(item), item->nkey, 0);
+    hv = ITEM_hv(item);
     item_lock(hv);
     ret = do_item_link(item, hv);
     item_unlock(hv);
@@ -532,7 +976,7 @@ int item_link(item *item) {
  */
 void item_remove(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey, 0);
+    hv = ITEM_hv(item);
 
     item_lock(hv);
     do_item_remove(item);
@@ -553,7 +997,7 @@ int item_replace(item *old_it, item *new_it, const uint32_t hv) {
  */
 void item_unlink(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey, 0);
+    hv = ITEM_hv(item);
     item_lock(hv);
     do_item_unlink(item, hv);
     item_unlock(hv);
@@ -564,7 +1008,10 @@ void item_unlink(item *item) {
  */
 void item_update(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey, 0);
+
+    if (!item_update_due(item))
+        return;
+    hv = ITEM_hv(item);
 
     item_lock(hv);
     do_item_update(item);
@@ -595,58 +1042,13 @@ enum store_item_type store_item(item *item, int comm, conn* c) {
     enum store_item_type ret;
     uint32_t hv;
 
-    hv = hash(ITEM_key(item), item->nkey, 0);
+    hv = ITEM_hv(item);
     item_lock(hv);
     ret = do_store_item(item, comm, c, hv);
     item_unlock(hv);
     return ret;
 }
 
-/*
- * Flushes expired items after a flush_all call
- */
-void item_flush_expired() {
-    mutex_lock(&cache_lock);
-    do_item_flush_expired();
-    mutex_unlock(&cache_lock);
-}
-
-/*
- * Dumps part of the cache
- */
-char *item_cachedump(unsigned int slabs_clsid, unsigned int limit, unsigned int *bytes) {
-    char *ret;
-
-    mutex_lock(&cache_lock);
-    ret = do_item_cachedump(slabs_clsid, limit, bytes);
-    mutex_unlock(&cache_lock);
-    return ret;
-}
-
-/*
- * Dumps statistics about slab classes
- */
-void  item_stats(ADD_STAT add_stats, void *c) {
-    mutex_lock(&cache_lock);
-    do_item_stats(add_stats, c);
-    mutex_unlock(&cache_lock);
-}
-
-void  item_stats_totals(ADD_STAT add_stats, void *c) {
-    mutex_lock(&cache_lock);
-    do_item_stats_totals(add_stats, c);
-    mutex_unlock(&cache_lock);
-}
-
-/*
- * Dumps a list of objects of each size in 32-byte increments
- */
-void  item_stats_sizes(ADD_STAT add_stats, void *c) {
-    mutex_lock(&cache_lock);
-    do_item_stats_sizes(add_stats, c);
-    mutex_unlock(&cache_lock);
-}
-
 /******************************* GLOBAL STATS ******************************/
 
 void STATS_LOCK() {
@@ -676,6 +1078,9 @@ void threadlocal_stats_reset(void) {
         threads[ii].stats.conn_yields = 0;
         threads[ii].stats.auth_cmds = 0;
         threads[ii].stats.auth_errors = 0;
+        threads[ii].stats.hotcache_hits = 0;
+        threads[ii].stats.hotcache_invalid = 0;
+        threads[ii].stats.hotcache_evictions = 0;
 
         for(sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
             threads[ii].stats.slab_stats[sid].set_cmds = 0;
@@ -716,6 +1121,9 @@ void threadlocal_stats_aggregate(struct thread_stats *stats) {
         stats->conn_yields += threads[ii].stats.conn_yields;
         stats->auth_cmds += threads[ii].stats.auth_cmds;
         stats->auth_errors += threads[ii].stats.auth_errors;
+        stats->hotcache_hits += threads[ii].stats.hotcache_hits;
+        stats->hotcache_invalid += threads[ii].stats.hotcache_invalid;
+        stats->hotcache_evictions += threads[ii].stats.hotcache_evictions;
 
         for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
             stats->slab_stats[sid].set_cmds +=
@@ -774,7 +1182,9 @@ void thread_init(int nthreads, struct event_base *main_base) {
     int         i;
     int         power;
 
-    pthread_mutex_init(&cache_lock, NULL);
+    for (i = 0; i < POWER_LARGEST; i++) {
+        pthread_mutex_init(&lru_locks[i], NULL);
+    }
     pthread_mutex_init(&stats_lock, NULL);
 
     pthread_mutex_init(&init_lock, NULL);
@@ -794,6 +1204,10 @@ void thread_init(int nthreads, struct event_base *main_base) {
         /* 8192 buckets, and central locks don't scale much past 5 threads */
         power = 13;
     }
+    /* Keys in one hash bucket must share a lock, as that lock is all that
+     * guards the bucket. The table never shrinks below its initial size. */
+    if ((unsigned int)power > hashpower)
+        power = hashpower;
 
     item_lock_count = hashsize(power);
 
@@ -805,6 +1219,11 @@ void thread_init(int nthreads, struct event_base *main_base) {
     for (i = 0; i < item_lock_count; i++) {
         pthread_mutex_init(&item_locks[i], NULL);
     }
+    item_lock_seqs = calloc(item_lock_count, sizeof(unsigned int));
+    if (! item_lock_seqs) {
+        perror("Can't allocate item lock sequences");
+        exit(1);
+    }
     pthread_key_create(&item_lock_type_key, NULL);
     pthread_mutex_init(&item_global_lock, NULL);
 